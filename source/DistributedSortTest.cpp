@@ -0,0 +1,115 @@
+// DistributedSortTest.cpp : launches several local ranks and runs distributedSort across them.
+//
+
+/**
+* Copyright(c) 2023 John Robinson.
+*
+*SPDX - License - Identifier: BSD - 3 - Clause
+*/
+
+#include <iostream>
+#include <random>
+#include <vector>
+#include <cstring>
+#include <iomanip>
+#include "distributedSort.hpp"
+
+// documentation of program arguments;
+void printHelp() {
+  std::cout << "Usage:\n";
+  std::cout << "DistributedSortTest [-np <ranks>] [-n <elements per rank>] [-threads <threads per rank>] [-unix | -tcp <base port>] [-g <seed>]\n";
+  std::cout << "  -np <ranks>: number of local processes to launch.  Default is 4\n";
+  std::cout << "  -n <elements per rank>: number of int64_t elements generated on each rank.  Default is 4M\n";
+  std::cout << "    Each rank then also sorts a small shard of rank + 1 elements, fewer than the samples each rank takes.\n";
+  std::cout << "  -threads <threads per rank>: threads given to parallelSort and the merge on each rank.  Default is 0 = hardware_concurrency\n";
+  std::cout << "  -unix or -tcp <base port>: connect the ranks with Unix-domain sockets or TCP sockets on 127.0.0.1.  Default is -unix\n";
+  std::cout << "  -g <random generator seed> used to vary the random numbers.  Default is 1.\n";
+}
+
+int main(int argc, char* argv[]) {
+  int nranks = 4;
+  size_t perRank = 4 * 1024 * 1024;
+  size_t threads = 0;
+  bool useTcp = false;
+  int basePort = 47000;
+  unsigned int seed = 1;
+
+  bool argError = false;
+  for (int arg = 1; arg < argc; arg++) {
+    bool oneMore = arg < (argc - 1);
+    if (strcmp(argv[arg], "-np") == 0 && oneMore) nranks = atoi(argv[++arg]);
+    else if (strcmp(argv[arg], "-n") == 0 && oneMore) perRank = atoll(argv[++arg]);
+    else if (strcmp(argv[arg], "-threads") == 0 && oneMore) threads = atoi(argv[++arg]);
+    else if (strcmp(argv[arg], "-tcp") == 0 && oneMore) { useTcp = true; basePort = atoi(argv[++arg]); }
+    else if (strcmp(argv[arg], "-unix") == 0) useTcp = false;
+    else if (strcmp(argv[arg], "-g") == 0 && oneMore) seed = atoi(argv[++arg]);
+    else if (strcmp(argv[arg], "-h") == 0) { printHelp(); return 0; }
+    else {
+      std::cout << "Argument " << argv[arg] << " not recognized" << std::endl;
+      argError = true;
+    }
+  }
+  if (argError || nranks < 1) {
+    printHelp();
+    return 1;
+  }
+
+  std::vector<sortEndpoint> endpoints = useTcp ? tcpEndpoints(nranks, "127.0.0.1", (uint16_t)basePort)
+    : unixEndpoints(nranks, "/tmp/psort." + std::to_string(getpid()));
+
+  std::cout << "Distributed sort of " << perRank << " int64_t elements on each of " << nranks << " ranks over "
+    << (useTcp ? "TCP" : "Unix-domain") << " sockets" << std::endl;
+
+  int failures = launchLocalRanks(nranks, [&](int rank, int nranks) {
+    sortComm comm(endpoints, rank);
+
+    std::mt19937_64 gen(seed + rank);
+    std::uniform_int_distribution<int64_t> dist(-10000000000LL, 10000000000LL);
+    int failed = 0;
+    // sort a shard of perRank elements, and then a shard smaller than the samples taken from each rank.
+    for (size_t count : { perRank, (size_t)rank + 1 }) {
+      std::vector<int64_t> local(count);
+      int64_t checksum = 0;
+      for (auto& v : local) { v = dist(gen); checksum += v; }
+
+      distributedSortTimes times;
+      distributedSort(comm, local, std::less<int64_t>(), threads, &times);
+
+      // verify: the local part is sorted, the element counts and checksums add up across ranks,
+      // and the last element on each rank is not larger than the first element on the next rank.
+      bool ok = std::is_sorted(local.begin(), local.end());
+      int64_t outChecksum = 0;
+      for (auto v : local) outChecksum += v;
+      std::vector<int64_t> summary = { (int64_t)count, checksum, (int64_t)local.size(), outChecksum,
+        local.empty() ? 0 : local.front(), local.empty() ? 0 : local.back(), (int64_t)local.empty() };
+      std::vector<int64_t> all;
+      std::vector<size_t> off;
+      comm.allGather(summary, all, off);
+      if (rank == 0) {
+        int64_t inCnt = 0, inSum = 0, outCnt = 0, outSum = 0;
+        bool haveLast = false;
+        int64_t last = 0;
+        for (int r = 0; r < nranks; r++) {
+          const int64_t* s = &all[off[r]];
+          inCnt += s[0]; inSum += s[1]; outCnt += s[2]; outSum += s[3];
+          if (s[6] == 0) {
+            if (haveLast && s[4] < last) ok = false;
+            last = s[5];
+            haveLast = true;
+          }
+        }
+        if (inCnt != outCnt || inSum != outSum) ok = false;
+      }
+
+      std::cout << std::fixed << std::setprecision(5) << "rank " << rank << ": " << std::setw(9) << local.size()
+        << " elements, local sort = " << times.localSort << " s, splitters = " << times.splitters
+        << " s, exchange = " << times.exchange << " s, merge = " << times.merge << " s"
+        << (ok ? "" : "  VERIFY FAILED") << std::endl;
+      if (!ok) failed = 1;
+    }
+    return failed;
+    });
+
+  std::cout << "Completed with " << failures << " rank failures." << std::endl;
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,182 @@
+// ParallelForTest.cpp : microbenchmark of the per-call and per-iteration overhead of parallelFor and parallelForRange,
+// and of the bandwidth of parallelReduce and the parallel scans against std::reduce and std::inclusive_scan.
+//
+
+/**
+* Copyright(c) 2023 John Robinson.
+*
+*SPDX - License - Identifier: BSD - 3 - Clause
+*/
+
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <cstring>
+#include <iomanip>
+#include <numeric>
+#if defined(STD_EXECUTION_TEST)
+#include <execution>
+#endif
+#include "parallelFor.hpp"
+
+// documentation of program arguments;
+void printHelp() {
+  std::cout << "Usage:\n";
+  std::cout << "ParallelForTest [-threads <threads>] [-n <iterations>] [-calls <calls>] [-grain <grain>]\n";
+  std::cout << "  -threads <threads>: number of threads.  Default is 0 = hardware_concurrency\n";
+  std::cout << "  -n <iterations>: number of iterations of the per-iteration loops.  Default is 16M\n";
+  std::cout << "  -calls <calls>: number of calls made to measure the per-call overhead.  Default is 1000\n";
+  std::cout << "  -grain <grain>: grain of the dynamic and guided schedules.  Default is 1024\n";
+  std::cout << "Built with -DSTD_EXECUTION_TEST, and -ltbb for libstdc++, std::reduce and std::inclusive_scan with std::execution::par are measured too.\n";
+}
+
+static const char* scheduleName(loopSchedule schedule) {
+  return schedule == schedStatic ? "static" : (schedule == schedDynamic ? "dynamic" : "guided");
+}
+
+template<class F>
+double timeIt(F fn) {
+  auto start = std::chrono::high_resolution_clock::now();
+  fn();
+  auto stop = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count() / 1e9;
+}
+
+int main(int argc, char* argv[]) {
+  int64_t threads = 0;
+  int64_t n = 16 * 1024 * 1024;
+  int64_t calls = 1000;
+  int64_t grain = 1024;
+
+  bool argError = false;
+  for (int arg = 1; arg < argc; arg++) {
+    bool oneMore = arg < (argc - 1);
+    if (strcmp(argv[arg], "-threads") == 0 && oneMore) threads = atoll(argv[++arg]);
+    else if (strcmp(argv[arg], "-n") == 0 && oneMore) n = atoll(argv[++arg]);
+    else if (strcmp(argv[arg], "-calls") == 0 && oneMore) calls = atoll(argv[++arg]);
+    else if (strcmp(argv[arg], "-grain") == 0 && oneMore) grain = atoll(argv[++arg]);
+    else if (strcmp(argv[arg], "-h") == 0) { printHelp(); return 0; }
+    else {
+      std::cout << "Argument " << argv[arg] << " not recognized" << std::endl;
+      argError = true;
+    }
+  }
+  if (argError || n < 1 || calls < 1) {
+    printHelp();
+    return 1;
+  }
+  if (threads == 0) threads = std::thread::hardware_concurrency();
+  if (threads == 0) threads = 1;
+  const loopSchedule schedules[] = { schedStatic, schedDynamic, schedGuided };
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "threads " << threads << ", n " << n << ", calls " << calls << ", grain " << grain << std::endl;
+
+  // per-call overhead: an empty body with one iteration per thread.
+  threadPool pool((size_t)threads);
+  poolExecutor poolExec(pool);
+  std::cout << "per-call overhead, microseconds per call" << std::endl;
+  double t = timeIt([&]() {
+    for (int64_t c = 0; c < calls; c++) parallelFor((int64_t)0, threads, [](int64_t) {}, threads);
+    });
+  std::cout << "  " << std::setw(34) << "parallelFor async: " << t * 1e6 / calls << std::endl;
+  t = timeIt([&]() {
+    for (int64_t c = 0; c < calls; c++) parallelFor(poolExec, (int64_t)0, threads, [](int64_t) {}, threads);
+    });
+  std::cout << "  " << std::setw(34) << "parallelFor pool: " << t * 1e6 / calls << std::endl;
+  for (loopSchedule schedule : schedules) {
+    t = timeIt([&]() {
+      for (int64_t c = 0; c < calls; c++) parallelForRange(poolExec, (int64_t)0, threads, [](int64_t, int64_t) {}, 1, schedule, threads);
+      });
+    std::cout << "  " << std::setw(32) << (std::string("parallelForRange pool ") + scheduleName(schedule)) << ": " << t * 1e6 / calls << std::endl;
+  }
+
+  // per-iteration overhead: y = a * x + y.
+  std::vector<float> x(n, 1.0f), y(n, 2.0f);
+  const float a = 0.5f;
+  std::cout << "per-iteration cost of y = a * x + y, nanoseconds per iteration" << std::endl;
+  t = timeIt([&]() {
+    for (int64_t i = 0; i < n; i++) y[i] = a * x[i] + y[i];
+    });
+  std::cout << "  " << std::setw(34) << "serial loop: " << t * 1e9 / n << std::endl;
+  t = timeIt([&]() {
+    parallelFor((int64_t)0, n, [&](int64_t i) { y[i] = a * x[i] + y[i]; }, threads);
+    });
+  std::cout << "  " << std::setw(34) << "parallelFor: " << t * 1e9 / n << std::endl;
+  for (loopSchedule schedule : schedules) {
+    t = timeIt([&]() {
+      parallelForRange((int64_t)0, n, [&](int64_t lb, int64_t le) {
+        for (int64_t i = lb; i < le; i++) y[i] = a * x[i] + y[i];
+        }, grain, schedule, threads);
+      });
+    std::cout << "  " << std::setw(32) << (std::string("parallelForRange ") + scheduleName(schedule)) << ": " << t * 1e9 / n << std::endl;
+  }
+
+  // uneven iterations: the cost of iteration i grows with i, so equal static chunks do not balance.
+  const int64_t m = std::max<int64_t>(n / 256, 1);
+  std::vector<double> z(m);
+  auto uneven = [&](int64_t i) {
+    double s = 0.0;
+    for (int64_t k = 0; k < i / 64; k++) s += std::sqrt(double(k + i));
+    z[i] = s;
+  };
+  std::cout << "uneven iterations, " << m << " iterations, milliseconds" << std::endl;
+  t = timeIt([&]() { parallelFor((int64_t)0, m, uneven, threads); });
+  std::cout << "  " << std::setw(34) << "parallelFor: " << t * 1e3 << std::endl;
+  for (loopSchedule schedule : schedules) {
+    t = timeIt([&]() {
+      parallelForRange((int64_t)0, m, [&](int64_t lb, int64_t le) {
+        for (int64_t i = lb; i < le; i++) uneven(i);
+        }, std::max<int64_t>(grain / 64, 1), schedule, threads);
+      });
+    std::cout << "  " << std::setw(32) << (std::string("parallelForRange ") + scheduleName(schedule)) << ": " << t * 1e3 << std::endl;
+  }
+
+  // bandwidth of the reductions and scans of int64_t, in GB/s of data read and written.
+  std::vector<int64_t> v(n), out(n), ref(n);
+  for (int64_t i = 0; i < n; i++) v[i] = (i * 7919) % 1000 - 500;
+  const double bytes = double(n) * sizeof(int64_t);
+  bool mismatch = false;
+  std::cout << "reduce and scan of int64_t, GB/s" << std::endl;
+  int64_t sumStd = 0, sumPar = 0;
+  t = timeIt([&]() { sumStd = std::reduce(v.begin(), v.end(), (int64_t)0); });
+  std::cout << "  " << std::setw(34) << "std::reduce: " << bytes / t / 1e9 << std::endl;
+#if defined(STD_EXECUTION_TEST) && defined(__cpp_lib_execution)
+  t = timeIt([&]() { sumPar = std::reduce(std::execution::par, v.begin(), v.end(), (int64_t)0); });
+  std::cout << "  " << std::setw(34) << "std::reduce(par): " << bytes / t / 1e9 << std::endl;
+#endif
+  t = timeIt([&]() { sumPar = parallelReduce(v.begin(), v.end(), (int64_t)0, std::plus<int64_t>(), grain, threads); });
+  std::cout << "  " << std::setw(34) << "parallelReduce: " << bytes / t / 1e9 << std::endl;
+  mismatch |= sumStd != sumPar;
+  int64_t maxPar = parallelTransformReduce(v.begin(), v.end(), std::numeric_limits<int64_t>::min(),
+    [](int64_t a, int64_t b) { return std::max(a, b); }, [](int64_t a) { return a < 0 ? -a : a; }, grain, threads);
+  mismatch |= maxPar != 500;
+
+  t = timeIt([&]() { std::inclusive_scan(v.begin(), v.end(), ref.begin()); });
+  std::cout << "  " << std::setw(34) << "std::inclusive_scan: " << 2.0 * bytes / t / 1e9 << std::endl;
+#if defined(STD_EXECUTION_TEST) && defined(__cpp_lib_execution)
+  t = timeIt([&]() { std::inclusive_scan(std::execution::par, v.begin(), v.end(), out.begin()); });
+  std::cout << "  " << std::setw(34) << "std::inclusive_scan(par): " << 2.0 * bytes / t / 1e9 << std::endl;
+#endif
+  t = timeIt([&]() { parallelInclusiveScan(v.begin(), v.end(), out.begin(), std::plus<int64_t>(), grain, threads); });
+  std::cout << "  " << std::setw(34) << "parallelInclusiveScan: " << 2.0 * bytes / t / 1e9 << std::endl;
+  mismatch |= out != ref;
+  std::exclusive_scan(v.begin(), v.end(), ref.begin(), (int64_t)10);
+  t = timeIt([&]() { parallelExclusiveScan(v.begin(), v.end(), out.begin(), (int64_t)10, std::plus<int64_t>(), grain, threads); });
+  std::cout << "  " << std::setw(34) << "parallelExclusiveScan: " << 2.0 * bytes / t / 1e9 << std::endl;
+  mismatch |= out != ref;
+  parallelInclusiveScan(v.begin(), v.end(), v.begin(), std::plus<int64_t>(), grain, threads);  // in place
+  mismatch |= v.back() != sumStd;
+  if (mismatch) {
+    std::cout << "parallel reduce or scan results do not match the std:: results" << std::endl;
+    return 1;
+  }
+
+  // check the results so that the loops are not optimized away.
+  double check = 0.0;
+  for (int64_t i = 0; i < n; i += 4096) check += y[i];
+  for (int64_t i = 0; i < m; i += 64) check += z[i];
+  std::cout << "checksum " << check << std::endl;
+  return 0;
+}
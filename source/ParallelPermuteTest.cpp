@@ -0,0 +1,128 @@
+// ParallelPermuteTest.cpp : measures the bandwidth of parallelGather, parallelScatter and parallelPermuteInPlace for records
+// of 4, 8, 16 and 64 bytes against plain loops, and checks their results.
+//
+
+/**
+* Copyright(c) 2023 John Robinson.
+*
+*SPDX - License - Identifier: BSD - 3 - Clause
+*/
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <cstring>
+#include <iomanip>
+#include <random>
+#include "parallelPermute.hpp"
+
+// documentation of program arguments;
+void printHelp() {
+  std::cout << "Usage:\n";
+  std::cout << "ParallelPermuteTest [-threads <threads>] [-bytes <bytes>] [-cycles <cycles>]\n";
+  std::cout << "  -threads <threads>: number of threads.  Default is 0 = hardware_concurrency\n";
+  std::cout << "  -bytes <bytes>: size of each array of records.  Default is 256M\n";
+  std::cout << "  -cycles <cycles>: if not 0, the permutation is made of cycles of this length instead of a random one.  Default is 0\n";
+}
+
+template<class F>
+double timeIt(F fn) {
+  auto start = std::chrono::high_resolution_clock::now();
+  fn();
+  auto stop = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count() / 1e9;
+}
+
+// record is W bytes, with its source position in the first 4 bytes so the results can be checked.
+template<size_t W>
+struct record {
+  uint32_t key;
+  char payload[W - sizeof(uint32_t)];
+};
+
+template<>
+struct record<4> {
+  uint32_t key;
+};
+
+template<size_t W>
+bool testWidth(size_t bytes, size_t cycles, size_t threads) {
+  typedef record<W> R;
+  const size_t n = bytes / W;
+  std::vector<uint32_t> perm(n);
+  for (size_t i = 0; i < n; i++) perm[i] = (uint32_t)i;
+  std::mt19937_64 rng(W);
+  if (cycles == 0) std::shuffle(perm.begin(), perm.end(), rng);
+  else {
+    // perm[i] = i + 1 within each cycle, and the cycles are shuffled through the array.
+    std::vector<uint32_t> order(perm);
+    std::shuffle(order.begin(), order.end(), rng);
+    for (size_t c = 0; c < n; c += cycles) {
+      size_t ce = std::min(n, c + cycles);
+      for (size_t i = c; i < ce; i++) perm[order[i]] = order[i + 1 < ce ? i + 1 : c];
+    }
+  }
+  std::vector<R> src(n), dst(n);
+  for (size_t i = 0; i < n; i++) {
+    src[i].key = (uint32_t)i;
+    dst[i].key = 0;
+  }
+  const double moved = 2.0 * double(n) * W;
+  bool ok = true;
+  auto check = [&](const char* name, bool gathered) {
+    bool good = true;
+    for (size_t i = 0; i < n && good; i++) good = gathered ? dst[i].key == perm[i] : dst[perm[i]].key == (uint32_t)i;
+    if (!good) std::cout << "  " << name << " failed for " << W << " byte records" << std::endl;
+    ok &= good;
+  };
+
+  std::cout << std::setw(3) << W << " byte records, GB/s";
+  double t = timeIt([&]() { for (size_t i = 0; i < n; i++) dst[i] = src[perm[i]]; });
+  std::cout << "  gather loop " << std::setw(6) << moved / t / 1e9;
+  t = timeIt([&]() { parallelGather(src.begin(), perm.begin(), n, dst.begin(), threads); });
+  std::cout << "  parallelGather " << std::setw(6) << moved / t / 1e9;
+  check("parallelGather", true);
+  t = timeIt([&]() { for (size_t i = 0; i < n; i++) dst[perm[i]] = src[i]; });
+  std::cout << "  scatter loop " << std::setw(6) << moved / t / 1e9;
+  t = timeIt([&]() { parallelScatter(src.begin(), perm.begin(), n, dst.begin(), threads); });
+  std::cout << "  parallelScatter " << std::setw(6) << moved / t / 1e9;
+  check("parallelScatter", false);
+  dst = src;
+  t = timeIt([&]() { parallelPermuteInPlace(dst.begin(), perm.begin(), n, threads); });
+  std::cout << "  parallelPermuteInPlace " << std::setw(6) << moved / t / 1e9 << std::endl;
+  check("parallelPermuteInPlace", true);
+  return ok;
+}
+
+int main(int argc, char* argv[]) {
+  size_t threads = 0;
+  size_t bytes = 256 * 1024 * 1024;
+  size_t cycles = 0;
+
+  bool argError = false;
+  for (int arg = 1; arg < argc; arg++) {
+    bool oneMore = arg < (argc - 1);
+    if (strcmp(argv[arg], "-threads") == 0 && oneMore) threads = atoll(argv[++arg]);
+    else if (strcmp(argv[arg], "-bytes") == 0 && oneMore) bytes = atoll(argv[++arg]);
+    else if (strcmp(argv[arg], "-cycles") == 0 && oneMore) cycles = atoll(argv[++arg]);
+    else if (strcmp(argv[arg], "-h") == 0) { printHelp(); return 0; }
+    else {
+      std::cout << "Argument " << argv[arg] << " not recognized" << std::endl;
+      argError = true;
+    }
+  }
+  if (argError || bytes < 64 || bytes / 4 > UINT32_MAX) {
+    printHelp();
+    return 1;
+  }
+  if (threads == 0) threads = std::thread::hardware_concurrency();
+  if (threads == 0) threads = 1;
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "threads " << threads << ", bytes " << bytes << ", " << (cycles == 0 ? std::string("random permutation") :
+    "cycles of " + std::to_string(cycles)) << std::endl;
+  bool ok = testWidth<4>(bytes, cycles, threads);
+  ok &= testWidth<8>(bytes, cycles, threads);
+  ok &= testWidth<16>(bytes, cycles, threads);
+  ok &= testWidth<64>(bytes, cycles, threads);
+  return ok ? 0 : 1;
+}
@@ -32,6 +32,9 @@ int main()
   parallelSort(s.begin(), s.end());
   print("sorted with the default operator<");
 
+  parallelSort(s);
+  print("sorted as a std::array with a sorting network");
+
   parallelSort(s.begin(), s.end(), std::greater<int>());
   print("sorted with the standard library compare function object");
 
@@ -61,8 +64,18 @@ int main()
 #include <cstring>
 #include <iomanip>
 #include <mutex>
+#include <atomic>
 #include "parallelFor.hpp"
 #include "parallelSort.hpp"
+#include "parallelSortAsync.hpp"
+#include "psort.hpp"
+#include "parallelPartition.hpp"
+#include "normalizedKey.hpp"
+#include "sortRecords.hpp"
+#include "sortVarLen.hpp"
+#ifdef __linux__
+#include <dirent.h>
+#endif
 
 // a slight rewrite of the Romdomer class from
 // https://stackoverflow.com/questions/13445688/how-to-generate-a-random-number-in-c/53887645#53887645
@@ -116,17 +129,20 @@ bool sortVerifier(RandomIt test_data, RandomIt reference, const size_t test_size
 
   // The verify portion makes sure the data is sorted correctly by checking that each array element is >= the one before it.
   // It also computes a checksum which is compared against the source data's checksum to check for data corruption.
-  parallelFor((size_t)1, test_size, [&errCnt, test_data, reference](size_t lc) {
+  // The range is checked in chunks taken dynamically by the threads, and the lock is only taken to report an error.
+  parallelForRange((size_t)1, test_size, [&errCnt, test_data, reference](size_t lb, size_t le) {
     static std::mutex lock;
-    std::lock_guard<std::mutex> guard(lock);
+    for (size_t lc = lb; lc < le; lc++) {
       if (*(test_data + lc) != *(reference + lc)) {
+        std::lock_guard<std::mutex> guard(lock);
         if (errCnt == 0) {
           std::cout << "First error at " << lc << std::endl;
           std::cout << "[" << lc << "] :" << *(test_data + lc) << " != " << *(reference + lc) << std::endl;
         }
         errCnt++;
       }
-    }, threads);
+    }
+    }, 65536, schedDynamic, threads);
   bool thisTestFailed = false;
   if (errCnt > 0) {
     std::cout << "Total of " << errCnt << " errors out of " << test_size << std::endl;
@@ -149,17 +165,20 @@ bool sortVerifierP(RandomIt test_data, RandomIt reference, const size_t test_siz
 
   // The verify portion makes sure the data is sorted correctly by checking that each array element is >= the one before it.
   // It also computes a checksum which is compared against the source data's checksum to check for data corruption.
-  parallelFor((size_t)1, test_size, [&errCnt, test_data, reference](size_t lc) {
+  // The range is checked in chunks taken dynamically by the threads, and the lock is only taken to report an error.
+  parallelForRange((size_t)1, test_size, [&errCnt, test_data, reference](size_t lb, size_t le) {
     static std::mutex lock;
-    std::lock_guard<std::mutex> guard(lock);
-    if (**(test_data + lc) != **(reference + lc)) {
-      if (errCnt == 0) {
-        std::cout << "First error at " << lc << std::endl;
-        std::cout << "[" << lc << "] :" << **(test_data + lc) << " != " << **(reference + lc) << std::endl;
+    for (size_t lc = lb; lc < le; lc++) {
+      if (**(test_data + lc) != **(reference + lc)) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (errCnt == 0) {
+          std::cout << "First error at " << lc << std::endl;
+          std::cout << "[" << lc << "] :" << **(test_data + lc) << " != " << **(reference + lc) << std::endl;
+        }
+        errCnt++;
       }
-      errCnt++;
     }
-    }, threads);
+    }, 65536, schedDynamic, threads);
   bool thisTestFailed = false;
   if (errCnt > 0) {
     std::cout << "Total of " << errCnt << " errors out of " << test_size << std::endl;
@@ -456,150 +475,1858 @@ public:
 };
 
 
-// documentation of program arguments;
-void printHelp() {
-  std::cout << "Usage:\n";
-  std::cout << "ParallelSortTest [-t <test number>] [-n <test_size> | -rs] [-minT <min threads>] [-maxT <max threads>] [-l <num tests per thread>] [-dr | -do | db] [-v | -nv]\n";
-  std::cout << "  -t <test number> indicates test to run\n";
-  std::cout << "     1 = sort array integers, 2 = sort std::vector of integers, 3 = sort vector of pointers to strings.  Default = 1\n";
-  std::cout << "  -n <test size>: number of elements to sort on each test loop.\n";
-  std::cout << "  -rs: randomize the test size.  Default \n";
-  std::cout << "  -minT <min Threads>\n";
-  std::cout << "  -maxT <max Threads> minT and maxT set the minimum and maximum threads the program will loop over.  Defaults are 1 and 8 \n";
-  std::cout << "  -l <num tests per thread> sets tnu number of tests that will be run for each thread\n";
-  std::cout << "  -dr | do | -db set the type of data for each test; random or ordered or reverse ordered respectively.  Default is -dr\n";
-  std::cout << "  -v or -nv indicate whether to verify the sort  Default is -v\n";
-  std::cout << "  -g <random generator seed> used to vary the random numbers.  Default is 1.\n";
-}
+// This is the test case for sort test #4.  It measures many simultaneous callers of parallelSort.
+// The data is generated in source_data[] and copied to one test array per caller.  For the test,
+// <threads> caller threads are started at once and each one sorts its own array with parallelSort
+// using the default number of threads, so the concurrencyGovernor decides how many threads each call
+// gets.  The time returned is the time for all of the callers to finish.  Use -nogov to turn off the
+// governor and see the effect of every call starting hardware_concurrency threads.
+// For verification, each caller's array is compared to the reference sorted with std::sort.
+class concurrentCallersSortCase : SortCase {
 
+  int64_t* source_data = nullptr;
+  std::vector<std::vector<int64_t>> test_data;
 
-int main(int argc, char* argv[]) {
+public:
+  concurrentCallersSortCase() {
+  }
 
-  // default settings
-  bool fixedTestSize = false;
-  size_t fixedTestSizeNum = 1024 * 1024 * 16;
-  size_t minThreads = 1;
-  size_t maxThreads = 8;
-  bool verifySort = true;
-  size_t sortTestSel = 1;
-  size_t num_tests = 25;
-  size_t dataType = dtRandom;
-  int64_t random_seed = 1;
+  void generateData(size_t test_size, size_t data_type, unsigned int random_seed) {
 
-  // parse the program arguments
-  bool argError = false;
-  for (size_t arg = 1; arg < argc; arg++) {
-    bool oneMore = arg < (argc - 1);
-    if (strcmp(argv[arg], "-minT") == 0) {
-      arg++;
-      if (!oneMore || 0 == (minThreads = atoi(argv[arg]))) {
-        std::cout << "-minT requires a non-zero integer argument." << std::endl;
-        argError = true;
-      }
-    }
-    else if (strcmp(argv[arg], "-maxT") == 0) {
-      arg++;
-      if (!oneMore || 0 == (maxThreads = atoi(argv[arg]))) {
-        std::cout << "-maxT requires a non-zero integer argument." << std::endl;
-        argError = true;
-      }
+    if (source_data != nullptr) delete[] source_data;
+    source_data = new int64_t[test_size];
+    RandomIntervalInt<int64_t> riTestData = RandomIntervalInt<int64_t>(-10000000000LL, 10000000000LL, random_seed);
+
+    // create the requested data type.
+    switch (data_type) {
+    case dtRandom: { // generate random data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = riTestData();
+      break;
     }
-    else if (strcmp(argv[arg], "-n") == 0) {
-      arg++;
-      if (!oneMore || 0 == (fixedTestSizeNum = atoi(argv[arg]))) {
-        std::cout << "-n requires a non-zero integer argument." << std::endl;
-        argError = true;
-      }
-      fixedTestSize = true;
+    case dtOrdered: {  // generate ordered data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = (i);
+      break;
     }
-    else if (strcmp(argv[arg], "-t") == 0) {
-      arg++;
-      if (!oneMore || 0 == (sortTestSel = atoi(argv[arg]))) {
-        std::cout << "-t requires a non-zero integer argument." << std::endl;
-        argError = true;
-      }
+    case dtReverseOrdered: { // generate reverse ordered data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = (test_size - i);
+      break;
     }
-    else if (strcmp(argv[arg], "-l") == 0) {
-      arg++;
-      if (!oneMore || 0 == (num_tests = atoi(argv[arg]))) {
-        std::cout << "-l requires a non-zero integer argument." << std::endl;
-        argError = true;
-      }
+    default: {
+      std::cout << "No such data type: " << data_type << std::endl;
+      exit(1);
     }
-    else if (strcmp(argv[arg], "-g") == 0) {
-      arg++;
-      if (!oneMore || 0 == (random_seed = atoi(argv[arg]))) {
-        std::cout << "-g requires a non-zero integer argument." << std::endl;
-        argError = true;
-      }
     }
-    else if (strcmp(argv[arg], "-rs") == 0) {
-      fixedTestSize = false;
+  }
+
+  double runSort(size_t test_size, size_t threads) {
+
+    // one copy of the source data for each caller.
+    test_data.assign(threads, std::vector<int64_t>(source_data, source_data + test_size));
+
+    // Get starting timepoint
+    auto start = std::chrono::high_resolution_clock::now();
+    // start all of the callers
+    std::vector<std::thread> callers;
+    for (size_t c = 0; c < threads; c++) {
+      callers.emplace_back([this, c]() {
+        parallelSort(test_data[c].begin(), test_data[c].end());
+        });
     }
-    else if (strcmp(argv[arg], "-dr") == 0) {
-      dataType = dtRandom;
+    for (auto& caller : callers) caller.join();
+    auto stop = std::chrono::high_resolution_clock::now();
+
+    // calculate and return the execution time.
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
+    return (duration.count() / 1000000.0);
+  }
+
+  bool verifySort(size_t test_size) {
+
+    // generate the reference data
+    std::vector<int64_t> reference(source_data, source_data + test_size);
+    std::sort(reference.begin(), reference.end());
+    bool thisTestFailed = false;
+    for (auto& td : test_data) {
+      if (sortVerifier(td.begin(), reference.begin(), test_size)) thisTestFailed = true;
     }
-    else if (strcmp(argv[arg], "-do") == 0) {
-      dataType = dtOrdered;
+    return thisTestFailed;
+  }
+
+  void cleanup() {
+    delete[] source_data;
+    source_data = nullptr;
+    test_data.clear();
+  }
+
+};
+
+
+// This is the test case for sort test #5.  It measures how much a large sort slows down latency sensitive work
+// running at the same time.  The data is generated in source_data[] like test #1.  For the test, a foreground
+// thread repeatedly sorts a small array with std::sort and records the latency of each of those sorts while
+// the large array is sorted with <threads> threads, either with parallelSort or, with -bg, with
+// parallelSortBackground.  The foreground latency percentiles are printed with and without the large sort.
+// For verification, the large array is compared to the reference sorted with std::sort.
+class foregroundLatencySortCase : SortCase {
+
+  int64_t* source_data = nullptr;
+  int64_t* test_data = nullptr;
+  bool background;
+  size_t maxMergeTasks;
+
+  // sort a small array over and over until done is set, or loops times, and print the latency percentiles.
+  static void foreground(const char* name, std::atomic<bool>& done, size_t loops) {
+    RandomIntervalInt<int64_t> ri = RandomIntervalInt<int64_t>(-10000000000LL, 10000000000LL, 7);
+    std::vector<int64_t> small(4096);
+    std::vector<double> latency;
+    for (size_t l = 0; !done && (loops == 0 || l < loops); l++) {
+      for (auto& v : small) v = ri();
+      auto start = std::chrono::high_resolution_clock::now();
+      std::sort(small.begin(), small.end());
+      auto stop = std::chrono::high_resolution_clock::now();
+      latency.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count() / 1000.0);
     }
-    else if (strcmp(argv[arg], "-db") == 0) {
-      dataType = dtReverseOrdered;
+    if (latency.empty()) return;
+    std::sort(latency.begin(), latency.end());
+    std::cout << "  foreground " << name << ": " << latency.size() << " sorts, latency us p50 = " << std::fixed << std::setprecision(1)
+      << latency[latency.size() / 2] << " p99 = " << latency[latency.size() * 99 / 100] << " max = " << latency.back() << std::endl;
+  }
+
+public:
+  foregroundLatencySortCase(bool background, size_t maxMergeTasks) : background(background), maxMergeTasks(maxMergeTasks) {
+  }
+
+  void generateData(size_t test_size, size_t data_type, unsigned int random_seed) {
+
+    if (source_data != nullptr) delete[] source_data;
+    source_data = new int64_t[test_size];
+    if (test_data != nullptr) delete[] test_data;
+    test_data = new  int64_t[test_size];
+    RandomIntervalInt<int64_t> riTestData = RandomIntervalInt<int64_t>(-10000000000LL, 10000000000LL, random_seed);
+
+    // create the requested data type.
+    switch (data_type) {
+    case dtRandom: { // generate random data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = riTestData();
+      break;
     }
-    else if (strcmp(argv[arg], "-nv") == 0) {
-      verifySort = false;
+    case dtOrdered: {  // generate ordered data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = (i);
+      break;
     }
-    else if (strcmp(argv[arg], "-v") == 0) {
-      verifySort = true;
+    case dtReverseOrdered: { // generate reverse ordered data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = (test_size - i);
+      break;
     }
-    else if (strcmp(argv[arg], "-h") == 0) {
-      printHelp();
-      return(0);
+    default: {
+      std::cout << "No such data type: " << data_type << std::endl;
+      exit(1);
     }
-    else {
-      std::cout << "Argument " << argv[arg] << " not recognized" << std::endl;
-      printHelp();
-      argError = true;
     }
   }
-  if (argError) {
-    return 1;
-  }
 
-  // print out the data type part of the output header
-  switch (dataType) {
-  case dtRandom: {
-    std::cout << "Random data: "; break;
-  }
-  case dtOrdered: {
-    std::cout << "Ordered data: "; break;
+  double runSort(size_t test_size, size_t threads) {
+
+    memcpy(test_data, source_data, test_size * sizeof(int64_t));
+
+    // the foreground latency with nothing else running.
+    std::atomic<bool> done{ false };
+    foreground("alone", done, 200);
+
+    // then the same with the large sort running.
+    std::thread fg([this, &done]() { foreground(background ? "with background sort" : "with parallelSort", done, 0); });
+
+    // Get starting timepoint
+    auto start = std::chrono::high_resolution_clock::now();
+    // call the sort case
+    if (background) parallelSortBackground(test_data, test_data + test_size, std::less<int64_t>(), threads, maxMergeTasks);
+    else parallelSort(test_data, test_data + test_size, threads);
+    auto stop = std::chrono::high_resolution_clock::now();
+    done = true;
+    fg.join();
+
+    // calculate and return the execution time.
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
+    return (duration.count() / 1000000.0);
   }
-  case dtReverseOrdered: {
-    std::cout << "ReverseOrdered data: "; break;
+
+  bool verifySort(size_t test_size) {
+
+    // generate the reference data
+    std::vector<int64_t> reference(source_data, source_data + test_size);
+    std::sort(reference.begin(), reference.end());
+    return sortVerifier(test_data, reference.data(), test_size);
   }
-  default: {
-    std::cout << "No such data type: " << dataType << std::endl;
-    exit(1);
+
+  void cleanup() {
+    delete[] source_data;
+    delete[] test_data;
+    source_data = nullptr;
+    test_data = nullptr;
   }
+
+};
+
+// This is the test case for sort test #6.  The data is generated in source_data[] like test #1.
+// For the test, the data is copied to test_data[] and sorted with parallelSortAsync on the global thread pool.
+// While the sort runs, the calling thread overlaps other work, here copying the source data for the next batch
+// to next_data[], and then waits on the sortFuture.  For verification, test_data[] is compared to the reference
+// sorted with std::sort.
+class asyncSortCase : SortCase {
+
+  int64_t* source_data = nullptr;
+  int64_t* test_data = nullptr;
+  int64_t* next_data = nullptr;
+
+public:
+  asyncSortCase() {
   }
 
-  // print out the test case part of the program header and set the test case.
-  SortCase* sortCase = nullptr;
-  switch (sortTestSel) {
-  case 1: {
-    std::cout << "Sort Test Case " << sortTestSel << ", array default direction" << std::endl;
-    sortCase = (SortCase*)new arraySortCase();
-    break;
+  void generateData(size_t test_size, size_t data_type, unsigned int random_seed) {
+
+    if (source_data != nullptr) delete[] source_data;
+    source_data = new int64_t[test_size];
+    if (test_data != nullptr) delete[] test_data;
+    test_data = new  int64_t[test_size];
+    if (next_data != nullptr) delete[] next_data;
+    next_data = new  int64_t[test_size];
+    RandomIntervalInt<int64_t> riTestData = RandomIntervalInt<int64_t>(-10000000000LL, 10000000000LL, random_seed);
+
+    // create the requested data type.
+    switch (data_type) {
+    case dtRandom: { // generate random data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = riTestData();
+      break;
+    }
+    case dtOrdered: {  // generate ordered data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = (i);
+      break;
+    }
+    case dtReverseOrdered: { // generate reverse ordered data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = (test_size - i);
+      break;
+    }
+    default: {
+      std::cout << "No such data type: " << data_type << std::endl;
+      exit(1);
+    }
+    }
   }
-  case 2: {
-    std::cout << "Sort Test Case " << sortTestSel << ", vector largest to smallest" << std::endl;
-    sortCase = (SortCase*)new vectorSortCase();
-    break;
+
+  double runSort(size_t test_size, size_t threads) {
+
+    memcpy(test_data, source_data, test_size * sizeof(int64_t));
+
+    // Get starting timepoint
+    auto start = std::chrono::high_resolution_clock::now();
+    // start the sort and do other work while it runs.
+    sortFuture sorted = parallelSortAsync(test_data, test_data + test_size, std::less<int64_t>(), threads);
+    memcpy(next_data, source_data, test_size * sizeof(int64_t));
+    auto overlapped = std::chrono::high_resolution_clock::now();
+    sorted.wait();
+    auto stop = std::chrono::high_resolution_clock::now();
+
+    auto overlap = std::chrono::duration_cast<std::chrono::microseconds>(overlapped - start);
+    std::cout << "  overlapped work took " << std::fixed << std::setprecision(5) << overlap.count() / 1000000.0 << " seconds" << std::endl;
+
+    // calculate and return the execution time.
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
+    return (duration.count() / 1000000.0);
+  }
+
+  bool verifySort(size_t test_size) {
+
+    // generate the reference data
+    std::vector<int64_t> reference(source_data, source_data + test_size);
+    std::sort(reference.begin(), reference.end());
+    return sortVerifier(test_data, reference.data(), test_size);
+  }
+
+  void cleanup() {
+    delete[] source_data;
+    delete[] test_data;
+    delete[] next_data;
+    source_data = nullptr;
+    test_data = nullptr;
+    next_data = nullptr;
+  }
+
+};
+
+// This is the test case for sort test #7.  It compares the executor backends.  The data is generated in
+// source_data[] like test #1.  For the test, the data is copied to test_data[] and sorted with parallelSort
+// on each of the available executors in turn: the default std::async executor, a poolExecutor on the global
+// thread pool, an openmpExecutor when compiled with OpenMP and the inlineExecutor.  The time for each one is
+// printed and the time of the default executor is returned.  For verification, the result of every executor
+// is compared to the reference sorted with std::sort.
+class executorSortCase : SortCase {
+
+  int64_t* source_data = nullptr;
+  int64_t* test_data = nullptr;
+  bool anyFailed = false;
+
+  template<class E>
+  double timeSort(const char* name, E& exec, size_t test_size, size_t threads) {
+    memcpy(test_data, source_data, test_size * sizeof(int64_t));
+    auto start = std::chrono::high_resolution_clock::now();
+    parallelSort(exec, test_data, test_data + test_size, std::less<int64_t>(), threads);
+    auto stop = std::chrono::high_resolution_clock::now();
+    double seconds = std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count() / 1000000.0;
+    std::cout << "  " << std::setw(8) << name << " executor: " << std::fixed << std::setprecision(5) << seconds << " seconds" << std::endl;
+    if (!std::is_sorted(test_data, test_data + test_size)) {
+      std::cout << "  " << name << " executor did not sort the data" << std::endl;
+      anyFailed = true;
+    }
+    return seconds;
+  }
+
+public:
+  executorSortCase() {
+  }
+
+  void generateData(size_t test_size, size_t data_type, unsigned int random_seed) {
+
+    if (source_data != nullptr) delete[] source_data;
+    source_data = new int64_t[test_size];
+    if (test_data != nullptr) delete[] test_data;
+    test_data = new  int64_t[test_size];
+    RandomIntervalInt<int64_t> riTestData = RandomIntervalInt<int64_t>(-10000000000LL, 10000000000LL, random_seed);
+
+    // create the requested data type.
+    switch (data_type) {
+    case dtRandom: { // generate random data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = riTestData();
+      break;
+    }
+    case dtOrdered: {  // generate ordered data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = (i);
+      break;
+    }
+    case dtReverseOrdered: { // generate reverse ordered data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = (test_size - i);
+      break;
+    }
+    default: {
+      std::cout << "No such data type: " << data_type << std::endl;
+      exit(1);
+    }
+    }
+  }
+
+  double runSort(size_t test_size, size_t threads) {
+    poolExecutor pool;
+    inlineExecutor serial;
+    timeSort("pool", pool, test_size, threads);
+#ifdef _OPENMP
+    openmpExecutor omp;
+    timeSort("openmp", omp, test_size, threads);
+#endif
+    timeSort("inline", serial, test_size, threads);
+    // the default executor last so its result is the one verified against the reference.
+    return timeSort("async", defaultExecutor(), test_size, threads);
+  }
+
+  bool verifySort(size_t test_size) {
+
+    // generate the reference data
+    std::vector<int64_t> reference(source_data, source_data + test_size);
+    std::sort(reference.begin(), reference.end());
+    bool thisTestFailed = sortVerifier(test_data, reference.data(), test_size) || anyFailed;
+    anyFailed = false;
+    return thisTestFailed;
+  }
+
+  void cleanup() {
+    delete[] source_data;
+    delete[] test_data;
+    source_data = nullptr;
+    test_data = nullptr;
+  }
+
+};
+
+// This is the test case for sort test #8.  It A/B tests the psort:: policy front end against the standard library.
+// The data is generated in source_data[] like test #1.  For the test, the data is copied to test_data[] and sorted
+// with std::sort and std::stable_sort using std::execution::par, when built with -DSTD_EXECUTION_TEST, and then with
+// psort::stable_sort and psort::sort using psort::par(threads).  The time of each one is printed and the time of
+// psort::sort is returned.  For verification, the psort::sort result is compared to the reference sorted with std::sort
+// and the psort::stable_sort result is checked to be sorted.
+class policySortCase : SortCase {
+
+  int64_t* source_data = nullptr;
+  int64_t* test_data = nullptr;
+  bool stableFailed = false;
+
+  template<class F>
+  double timeSort(const char* name, size_t test_size, F sortFn) {
+    memcpy(test_data, source_data, test_size * sizeof(int64_t));
+    auto start = std::chrono::high_resolution_clock::now();
+    sortFn(test_data, test_data + test_size);
+    auto stop = std::chrono::high_resolution_clock::now();
+    double seconds = std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count() / 1000000.0;
+    std::cout << "  " << std::setw(24) << name << ": " << std::fixed << std::setprecision(5) << seconds << " seconds" << std::endl;
+    return seconds;
+  }
+
+public:
+  policySortCase() {
+  }
+
+  void generateData(size_t test_size, size_t data_type, unsigned int random_seed) {
+
+    if (source_data != nullptr) delete[] source_data;
+    source_data = new int64_t[test_size];
+    if (test_data != nullptr) delete[] test_data;
+    test_data = new  int64_t[test_size];
+    RandomIntervalInt<int64_t> riTestData = RandomIntervalInt<int64_t>(-10000000000LL, 10000000000LL, random_seed);
+
+    // create the requested data type.
+    switch (data_type) {
+    case dtRandom: { // generate random data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = riTestData();
+      break;
+    }
+    case dtOrdered: {  // generate ordered data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = (i);
+      break;
+    }
+    case dtReverseOrdered: { // generate reverse ordered data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = (test_size - i);
+      break;
+    }
+    default: {
+      std::cout << "No such data type: " << data_type << std::endl;
+      exit(1);
+    }
+    }
+  }
+
+  double runSort(size_t test_size, size_t threads) {
+#if defined(STD_EXECUTION_TEST) && defined(__cpp_lib_execution)
+    timeSort("std::sort(par)", test_size, [](int64_t* b, int64_t* e) { std::sort(std::execution::par, b, e); });
+    timeSort("std::stable_sort(par)", test_size, [](int64_t* b, int64_t* e) { std::stable_sort(std::execution::par, b, e); });
+#endif
+    timeSort("psort::stable_sort(par)", test_size, [threads](int64_t* b, int64_t* e) { psort::stable_sort(psort::par(threads), b, e); });
+    stableFailed = !std::is_sorted(test_data, test_data + test_size);
+    return timeSort("psort::sort(par)", test_size, [threads](int64_t* b, int64_t* e) { psort::sort(psort::par(threads), b, e); });
+  }
+
+  bool verifySort(size_t test_size) {
+
+    // generate the reference data
+    std::vector<int64_t> reference(source_data, source_data + test_size);
+    std::sort(reference.begin(), reference.end());
+    if (stableFailed) std::cout << "psort::stable_sort did not sort the data" << std::endl;
+    return sortVerifier(test_data, reference.data(), test_size) || stableFailed;
+  }
+
+  void cleanup() {
+    delete[] source_data;
+    delete[] test_data;
+    source_data = nullptr;
+    test_data = nullptr;
+  }
+
+};
+
+// This is the test case for sort test #9.  It sorts many independent segments, like the rows of a CSR matrix, with parallelSegmentedSort.
+// The data is generated in source_data[] like test #1 and cut into segments with random lengths: most have 10 to 100 elements,
+// about 1 in 10 has up to 10000 and about 1 in 1000 has up to test_size / 20.  The time of sorting each segment with std::sort
+// on one thread is printed for comparison.  For verification, each segment of the reference is sorted with std::sort.
+class segmentedSortCase : SortCase {
+
+  int64_t* source_data = nullptr;
+  int64_t* test_data = nullptr;
+  std::vector<size_t> offsets;
+
+public:
+  segmentedSortCase() {
+  }
+
+  void generateData(size_t test_size, size_t data_type, unsigned int random_seed) {
+
+    if (source_data != nullptr) delete[] source_data;
+    source_data = new int64_t[test_size];
+    if (test_data != nullptr) delete[] test_data;
+    test_data = new  int64_t[test_size];
+    RandomIntervalInt<int64_t> riTestData = RandomIntervalInt<int64_t>(-10000000000LL, 10000000000LL, random_seed);
+
+    // create the requested data type.
+    switch (data_type) {
+    case dtRandom: { // generate random data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = riTestData();
+      break;
+    }
+    case dtOrdered: {  // generate ordered data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = (i);
+      break;
+    }
+    case dtReverseOrdered: { // generate reverse ordered data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = (test_size - i);
+      break;
+    }
+    default: {
+      std::cout << "No such data type: " << data_type << std::endl;
+      exit(1);
+    }
+    }
+
+    // cut the data into segments.
+    RandomIntervalInt<size_t> riKind = RandomIntervalInt<size_t>(0, 999, random_seed + 1);
+    RandomIntervalInt<size_t> riSmall = RandomIntervalInt<size_t>(10, 100, random_seed + 2);
+    RandomIntervalInt<size_t> riMedium = RandomIntervalInt<size_t>(100, 10000, random_seed + 3);
+    RandomIntervalInt<size_t> riLarge = RandomIntervalInt<size_t>(10000, maximum(test_size / 20, 10000), random_seed + 4);
+    offsets.assign(1, 0);
+    while (offsets.back() < test_size) {
+      size_t kind = riKind();
+      size_t n = kind == 0 ? riLarge() : (kind < 100 ? riMedium() : riSmall());
+      offsets.push_back(minimum(offsets.back() + n, test_size));
+    }
+  }
+
+  double runSort(size_t test_size, size_t threads) {
+    memcpy(test_data, source_data, test_size * sizeof(int64_t));
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t s = 0; s + 1 < offsets.size(); s++) std::sort(test_data + offsets[s], test_data + offsets[s + 1]);
+    auto stop = std::chrono::high_resolution_clock::now();
+    std::cout << "  " << offsets.size() - 1 << " segments, std::sort per segment: " << std::fixed << std::setprecision(5)
+      << std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count() / 1000000.0 << " seconds" << std::endl;
+
+    memcpy(test_data, source_data, test_size * sizeof(int64_t));
+    start = std::chrono::high_resolution_clock::now();
+    parallelSegmentedSort(test_data, offsets, threads);
+    stop = std::chrono::high_resolution_clock::now();
+
+    // calculate and return the execution time.
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
+    return (duration.count() / 1000000.0);
+  }
+
+  bool verifySort(size_t test_size) {
+
+    // generate the reference data
+    std::vector<int64_t> reference(source_data, source_data + test_size);
+    for (size_t s = 0; s + 1 < offsets.size(); s++) std::sort(reference.begin() + offsets[s], reference.begin() + offsets[s + 1]);
+    return sortVerifier(test_data, reference.data(), test_size);
+  }
+
+  void cleanup() {
+    delete[] source_data;
+    delete[] test_data;
+    source_data = nullptr;
+    test_data = nullptr;
+  }
+
+};
+
+// This is the test case for sort test #10.  It checks that parallelSort never runs more threads than it is given.
+// The data is generated in source_data[] like test #1 and sorted in test_data[] with parallelSort on the default executor.
+// While the sort runs, a monitor thread counts the threads of the process in /proc/self/task.  The sort may add at most
+// threads - 1 threads to the main and monitor threads, since the calling thread is one of its workers.  The peak is
+// printed, and the test fails if it is over the budget.  The thread count is only available on Linux.
+class threadBudgetSortCase : SortCase {
+
+  int64_t* source_data = nullptr;
+  int64_t* test_data = nullptr;
+  size_t peakThreads = 0;
+  size_t budget = 0;
+
+  static size_t processThreads() {
+#ifdef __linux__
+    size_t count = 0;
+    DIR* dir = opendir("/proc/self/task");
+    if (dir == nullptr) return 0;
+    while (struct dirent* entry = readdir(dir)) if (entry->d_name[0] != '.') count++;
+    closedir(dir);
+    return count;
+#else
+    return 0;
+#endif
+  }
+
+public:
+  threadBudgetSortCase() {
+  }
+
+  void generateData(size_t test_size, size_t data_type, unsigned int random_seed) {
+
+    if (source_data != nullptr) delete[] source_data;
+    source_data = new int64_t[test_size];
+    if (test_data != nullptr) delete[] test_data;
+    test_data = new  int64_t[test_size];
+    RandomIntervalInt<int64_t> riTestData = RandomIntervalInt<int64_t>(-10000000000LL, 10000000000LL, random_seed);
+
+    // create the requested data type.
+    switch (data_type) {
+    case dtRandom: { // generate random data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = riTestData();
+      break;
+    }
+    case dtOrdered: {  // generate ordered data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = (i);
+      break;
+    }
+    case dtReverseOrdered: { // generate reverse ordered data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = (test_size - i);
+      break;
+    }
+    default: {
+      std::cout << "No such data type: " << data_type << std::endl;
+      exit(1);
+    }
+    }
+  }
+
+  double runSort(size_t test_size, size_t threads) {
+    memcpy(test_data, source_data, test_size * sizeof(int64_t));
+    budget = threads;
+
+    // start the monitor and wait until it has taken its first count.
+    std::atomic<bool> done{ false };
+    std::atomic<size_t> peak{ 0 };
+    std::thread monitor([&]() {
+      while (!done) {
+        size_t n = processThreads();
+        if (n > peak) peak = n;
+      }
+      });
+    while (peak == 0) std::this_thread::yield();
+    const size_t baseline = peak;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    parallelSort(test_data, test_data + test_size, threads);
+    auto stop = std::chrono::high_resolution_clock::now();
+    done = true;
+    monitor.join();
+    peakThreads = peak - baseline + 1;
+    std::cout << "  peak sort threads " << peakThreads << " of " << threads << std::endl;
+
+    // calculate and return the execution time.
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
+    return (duration.count() / 1000000.0);
+  }
+
+  bool verifySort(size_t test_size) {
+
+    // generate the reference data
+    std::vector<int64_t> reference(source_data, source_data + test_size);
+    std::sort(reference.begin(), reference.end());
+    bool overBudget = processThreads() != 0 && peakThreads > budget;
+    if (overBudget) std::cout << "parallelSort ran " << peakThreads << " threads with a budget of " << budget << std::endl;
+    return sortVerifier(test_data, reference.data(), test_size) || overBudget;
+  }
+
+  void cleanup() {
+    delete[] source_data;
+    delete[] test_data;
+    source_data = nullptr;
+    test_data = nullptr;
+  }
+
+};
+
+// This is the test case for sort test #11.  It groups the data into key-range buckets with parallelPartitionBySplitters.
+// The data is generated in source_data[] like test #1 and splitters for -buckets equal sized buckets are picked by sampling.
+// The time of a full parallelSort of the same data is printed for comparison.  For verification, the reference is
+// built serially by appending each element to its bucket in input order, which also checks that the partition is stable.
+class partitionSortCase : SortCase {
+
+  int64_t* source_data = nullptr;
+  int64_t* test_data = nullptr;
+  size_t buckets;
+  std::vector<int64_t> splitters;
+  std::vector<size_t> bucketOffsets;
+
+public:
+  partitionSortCase(size_t buckets) : buckets(buckets) {
+  }
+
+  void generateData(size_t test_size, size_t data_type, unsigned int random_seed) {
+
+    if (source_data != nullptr) delete[] source_data;
+    source_data = new int64_t[test_size];
+    if (test_data != nullptr) delete[] test_data;
+    test_data = new  int64_t[test_size];
+    RandomIntervalInt<int64_t> riTestData = RandomIntervalInt<int64_t>(-10000000000LL, 10000000000LL, random_seed);
+
+    // create the requested data type.
+    switch (data_type) {
+    case dtRandom: { // generate random data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = riTestData();
+      break;
+    }
+    case dtOrdered: {  // generate ordered data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = (i);
+      break;
+    }
+    case dtReverseOrdered: { // generate reverse ordered data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = (test_size - i);
+      break;
+    }
+    default: {
+      std::cout << "No such data type: " << data_type << std::endl;
+      exit(1);
+    }
+    }
+    splitters = chooseSplitters(source_data, source_data + test_size, buckets, std::less<int64_t>());
+  }
+
+  double runSort(size_t test_size, size_t threads) {
+    memcpy(test_data, source_data, test_size * sizeof(int64_t));
+    auto start = std::chrono::high_resolution_clock::now();
+    parallelSort(test_data, test_data + test_size, threads);
+    auto stop = std::chrono::high_resolution_clock::now();
+    std::cout << "  parallelSort: " << std::fixed << std::setprecision(5)
+      << std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count() / 1000000.0 << " seconds" << std::endl;
+
+    start = std::chrono::high_resolution_clock::now();
+    parallelPartitionBySplitters(source_data, source_data + test_size, splitters, test_data, bucketOffsets, std::less<int64_t>(), threads);
+    stop = std::chrono::high_resolution_clock::now();
+
+    // calculate and return the execution time.
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
+    return (duration.count() / 1000000.0);
+  }
+
+  bool verifySort(size_t test_size) {
+
+    // generate the reference data
+    std::vector<std::vector<int64_t>> bucketData(splitters.size() + 1);
+    for (size_t i = 0; i < test_size; i++) {
+      size_t b = std::upper_bound(splitters.begin(), splitters.end(), source_data[i]) - splitters.begin();
+      bucketData[b].push_back(source_data[i]);
+    }
+    std::vector<int64_t> reference;
+    bool offsetsFailed = bucketOffsets.size() != bucketData.size() + 1;
+    for (size_t b = 0; b < bucketData.size(); b++) {
+      if (!offsetsFailed && bucketOffsets[b] != reference.size()) offsetsFailed = true;
+      reference.insert(reference.end(), bucketData[b].begin(), bucketData[b].end());
+    }
+    if (offsetsFailed) std::cout << "bucketOffsets do not match the bucket sizes" << std::endl;
+    return sortVerifier(test_data, reference.data(), test_size) || offsetsFailed;
+  }
+
+  void cleanup() {
+    delete[] source_data;
+    delete[] test_data;
+    source_data = nullptr;
+    test_data = nullptr;
+  }
+
+};
+
+// This is the test case for sort test #12.  It sorts integers with a small range of values, which parallelSort counts instead of sorting.
+// The data is generated in source_data[] with values from 0 to 255, like status codes or shard ids: random, ordered or reverse ordered
+// and repeating.  The time of parallelSort with a lambda comparison, which is not counted, is printed for comparison, and so is the time of
+// parallelCountingSortBy of (key, index) records.  For verification, the result is compared to the reference sorted with std::sort, and the
+// records must be in key order with the indices of equal keys increasing, since parallelCountingSortBy is stable.
+class countingSortCase : SortCase {
+
+  int64_t* source_data = nullptr;
+  int64_t* test_data = nullptr;
+  bool recordsFailed = false;
+
+public:
+  countingSortCase() {
+  }
+
+  void generateData(size_t test_size, size_t data_type, unsigned int random_seed) {
+
+    if (source_data != nullptr) delete[] source_data;
+    source_data = new int64_t[test_size];
+    if (test_data != nullptr) delete[] test_data;
+    test_data = new  int64_t[test_size];
+    RandomIntervalInt<int64_t> riTestData = RandomIntervalInt<int64_t>(0, 255, random_seed);
+
+    // create the requested data type.
+    switch (data_type) {
+    case dtRandom: { // generate random data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = riTestData();
+      break;
+    }
+    case dtOrdered: {  // generate ordered data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = (i * 256 / test_size);
+      break;
+    }
+    case dtReverseOrdered: { // generate reverse ordered data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = ((test_size - i) * 256 / test_size);
+      break;
+    }
+    default: {
+      std::cout << "No such data type: " << data_type << std::endl;
+      exit(1);
+    }
+    }
+  }
+
+  double runSort(size_t test_size, size_t threads) {
+    memcpy(test_data, source_data, test_size * sizeof(int64_t));
+    auto start = std::chrono::high_resolution_clock::now();
+    parallelSort(test_data, test_data + test_size, [](int64_t a, int64_t b) { return a < b; }, threads);
+    auto stop = std::chrono::high_resolution_clock::now();
+    std::cout << "  comparison parallelSort: " << std::fixed << std::setprecision(5)
+      << std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count() / 1000000.0 << " seconds" << std::endl;
+
+    std::vector<std::pair<int64_t, size_t>> records(test_size);
+    for (size_t i = 0; i < test_size; i++) records[i] = { source_data[i], i };
+    start = std::chrono::high_resolution_clock::now();
+    parallelCountingSortBy(records.begin(), records.end(), [](const std::pair<int64_t, size_t>& r) { return r.first; }, threads);
+    stop = std::chrono::high_resolution_clock::now();
+    std::cout << "  parallelCountingSortBy records: " << std::fixed << std::setprecision(5)
+      << std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count() / 1000000.0 << " seconds" << std::endl;
+    recordsFailed = !std::is_sorted(records.begin(), records.end());
+
+    memcpy(test_data, source_data, test_size * sizeof(int64_t));
+    start = std::chrono::high_resolution_clock::now();
+    parallelSort(test_data, test_data + test_size, threads);
+    stop = std::chrono::high_resolution_clock::now();
+
+    // calculate and return the execution time.
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
+    return (duration.count() / 1000000.0);
+  }
+
+  bool verifySort(size_t test_size) {
+
+    // generate the reference data
+    std::vector<int64_t> reference(source_data, source_data + test_size);
+    std::sort(reference.begin(), reference.end());
+    if (recordsFailed) std::cout << "parallelCountingSortBy records are not in stable key order" << std::endl;
+    return sortVerifier(test_data, reference.data(), test_size) || recordsFailed;
+  }
+
+  void cleanup() {
+    delete[] source_data;
+    delete[] test_data;
+    source_data = nullptr;
+    test_data = nullptr;
+  }
+
+};
+
+// This is the test case for sort test #13.  It sorts int64_t values with a range that fits in 32 bits, which parallelSort sorts as narrow keys.
+// The data is generated in source_data[] like test #1 but from -1e9 to 1e9.  The time of parallelSort with a lambda comparison, which sorts the
+// full 8 byte values, is printed for comparison, and so is the time of parallelSortIndices.  For verification, the result is compared to the
+// reference sorted with std::sort, and the indices must point to the reference values in order with equal values in increasing position.
+// Where the compiler has __int128, the values are also sorted offset by 2^100, which must not take the 64 bit narrow key path.
+class narrowKeySortCase : SortCase {
+
+  int64_t* source_data = nullptr;
+  int64_t* test_data = nullptr;
+  std::vector<size_t> indices;
+#ifdef __SIZEOF_INT128__
+  std::vector<__int128> wide_data;
+  const __int128 wide_offset = (__int128)1 << 100;
+#endif
+
+public:
+  narrowKeySortCase() {
+  }
+
+  void generateData(size_t test_size, size_t data_type, unsigned int random_seed) {
+
+    if (source_data != nullptr) delete[] source_data;
+    source_data = new int64_t[test_size];
+    if (test_data != nullptr) delete[] test_data;
+    test_data = new  int64_t[test_size];
+    RandomIntervalInt<int64_t> riTestData = RandomIntervalInt<int64_t>(-1000000000LL, 1000000000LL, random_seed);
+
+    // create the requested data type.
+    switch (data_type) {
+    case dtRandom: { // generate random data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = riTestData();
+      break;
+    }
+    case dtOrdered: {  // generate ordered data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = (i) * 1000;
+      break;
+    }
+    case dtReverseOrdered: { // generate reverse ordered data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = (test_size - i) * 1000;
+      break;
+    }
+    default: {
+      std::cout << "No such data type: " << data_type << std::endl;
+      exit(1);
+    }
+    }
+  }
+
+  double runSort(size_t test_size, size_t threads) {
+    memcpy(test_data, source_data, test_size * sizeof(int64_t));
+    auto start = std::chrono::high_resolution_clock::now();
+    parallelSort(test_data, test_data + test_size, [](int64_t a, int64_t b) { return a < b; }, threads);
+    auto stop = std::chrono::high_resolution_clock::now();
+    std::cout << "  comparison parallelSort: " << std::fixed << std::setprecision(5)
+      << std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count() / 1000000.0 << " seconds" << std::endl;
+
+    start = std::chrono::high_resolution_clock::now();
+    parallelSortIndices(source_data, source_data + test_size, indices, threads);
+    stop = std::chrono::high_resolution_clock::now();
+    std::cout << "  parallelSortIndices: " << std::fixed << std::setprecision(5)
+      << std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count() / 1000000.0 << " seconds" << std::endl;
+
+#ifdef __SIZEOF_INT128__
+    wide_data.resize(test_size);
+    for (size_t i = 0; i < test_size; i++) wide_data[i] = source_data[i] + wide_offset;
+    start = std::chrono::high_resolution_clock::now();
+    parallelSort(wide_data.begin(), wide_data.end(), threads);
+    stop = std::chrono::high_resolution_clock::now();
+    std::cout << "  __int128 parallelSort: " << std::fixed << std::setprecision(5)
+      << std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count() / 1000000.0 << " seconds" << std::endl;
+#endif
+
+    memcpy(test_data, source_data, test_size * sizeof(int64_t));
+    start = std::chrono::high_resolution_clock::now();
+    parallelSort(test_data, test_data + test_size, threads);
+    stop = std::chrono::high_resolution_clock::now();
+
+    // calculate and return the execution time.
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
+    return (duration.count() / 1000000.0);
+  }
+
+  bool verifySort(size_t test_size) {
+
+    // generate the reference data
+    std::vector<int64_t> reference(source_data, source_data + test_size);
+    std::sort(reference.begin(), reference.end());
+    bool indicesFailed = indices.size() != test_size;
+    for (size_t i = 0; i < test_size && !indicesFailed; i++) {
+      indicesFailed = source_data[indices[i]] != reference[i] || (i > 0 && reference[i] == reference[i - 1] && indices[i] < indices[i - 1]);
+    }
+    if (indicesFailed) std::cout << "parallelSortIndices did not give the sorted order" << std::endl;
+    bool wideFailed = false;
+#ifdef __SIZEOF_INT128__
+    for (size_t i = 0; i < test_size && !wideFailed; i++) wideFailed = wide_data[i] != reference[i] + wide_offset;
+    if (wideFailed) std::cout << "parallelSort of __int128 values did not give the sorted order" << std::endl;
+#endif
+    return sortVerifier(test_data, reference.data(), test_size) || indicesFailed || wideFailed;
+  }
+
+  void cleanup() {
+    delete[] source_data;
+    delete[] test_data;
+    source_data = nullptr;
+    test_data = nullptr;
+  }
+
+};
+
+// This is the test case for sort tests #14 and #15.  It sorts doubles (#14) or floats (#15) of which -nans percent are NaNs, half of them
+// negative NaNs, and which include both -0.0 and +0.0.  The times of parallelSort with totalOrderLess, a comparison sort, and of parallelFloatSort
+// in IEEE totalOrder are printed for comparison, and the time returned is that of parallelSort with std::less, which puts the NaNs last.
+// For verification, the totalOrder result must match the reference sorted with std::sort and totalOrderLess bit for bit, and the std::less result
+// must hold the reference numbers in order followed by the NaNs.
+template<class T>
+class floatSortCase : SortCase {
+
+  T* source_data = nullptr;
+  T* test_data = nullptr;
+  std::vector<T> totalOrder;
+  double nanPercent;
+
+public:
+  floatSortCase(double nanPercent) : nanPercent(nanPercent) {
+  }
+
+  void generateData(size_t test_size, size_t data_type, unsigned int random_seed) {
+
+    if (source_data != nullptr) delete[] source_data;
+    source_data = new T[test_size];
+    if (test_data != nullptr) delete[] test_data;
+    test_data = new T[test_size];
+    RandomIntervalReal<double> riTestData = RandomIntervalReal<double>(-1000000.0, 1000000.0, random_seed);
+    RandomIntervalReal<double> riPercent = RandomIntervalReal<double>(0.0, 100.0, random_seed + 1);
+
+    // create the requested data type.
+    switch (data_type) {
+    case dtRandom: { // generate random data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = (T)riTestData();
+      break;
+    }
+    case dtOrdered: {  // generate ordered data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = (T)(double(i) - double(test_size / 2));
+      break;
+    }
+    case dtReverseOrdered: { // generate reverse ordered data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = (T)(double(test_size / 2) - double(i));
+      break;
+    }
+    default: {
+      std::cout << "No such data type: " << data_type << std::endl;
+      exit(1);
+    }
+    }
+    // replace nanPercent of the values with NaNs, and a few with zeros of either sign.
+    size_t nans = 0;
+    for (size_t i = 0; i < test_size; i++) {
+      if (riPercent() < nanPercent) source_data[i] = (nans++ % 2) ? -std::numeric_limits<T>::quiet_NaN() : std::numeric_limits<T>::quiet_NaN();
+      else if (i % 1000 == 0) source_data[i] = (i % 2000) ? (T)-0.0 : (T)0.0;
+    }
+  }
+
+  double runSort(size_t test_size, size_t threads) {
+    memcpy(test_data, source_data, test_size * sizeof(T));
+    auto start = std::chrono::high_resolution_clock::now();
+    parallelSort(test_data, test_data + test_size, totalOrderLess(), threads);
+    auto stop = std::chrono::high_resolution_clock::now();
+    std::cout << "  parallelSort with totalOrderLess: " << std::fixed << std::setprecision(5)
+      << std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count() / 1000000.0 << " seconds" << std::endl;
+
+    totalOrder.assign(source_data, source_data + test_size);
+    start = std::chrono::high_resolution_clock::now();
+    parallelFloatSort(totalOrder.begin(), totalOrder.end(), floatTotalOrder, false, threads);
+    stop = std::chrono::high_resolution_clock::now();
+    std::cout << "  parallelFloatSort: " << std::fixed << std::setprecision(5)
+      << std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count() / 1000000.0 << " seconds" << std::endl;
+
+    memcpy(test_data, source_data, test_size * sizeof(T));
+    start = std::chrono::high_resolution_clock::now();
+    parallelSort(test_data, test_data + test_size, std::less<T>(), threads);
+    stop = std::chrono::high_resolution_clock::now();
+
+    // calculate and return the execution time.
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
+    return (duration.count() / 1000000.0);
+  }
+
+  bool verifySort(size_t test_size) {
+
+    // generate the reference data
+    std::vector<T> reference(source_data, source_data + test_size);
+    std::sort(reference.begin(), reference.end(), totalOrderLess());
+    bool failed = memcmp(reference.data(), totalOrder.data(), test_size * sizeof(T)) != 0;
+    if (failed) std::cout << "parallelFloatSort did not give the IEEE totalOrder" << std::endl;
+
+    auto numbers = std::remove_if(reference.begin(), reference.end(), [](T v) { return v != v; });
+    size_t count = numbers - reference.begin();
+    bool lessFailed = false;
+    for (size_t i = 0; i < test_size && !lessFailed; i++) lessFailed = i < count ? !(test_data[i] == reference[i]) : test_data[i] == test_data[i];
+    if (lessFailed) std::cout << "parallelSort with std::less did not put the numbers in order and the NaNs last" << std::endl;
+    return failed || lessFailed;
+  }
+
+  void cleanup() {
+    delete[] source_data;
+    delete[] test_data;
+    source_data = nullptr;
+    test_data = nullptr;
+    totalOrder.clear();
+  }
+
+};
+
+// This is the test case for sort test #16.  It sorts records by the composite key (tenant, timestamp descending, seq) with parallelSortByKey,
+// which packs the key into a 128 bit normalizedKey.  The tenants and timestamps are drawn from small ranges so that many records tie on the
+// first fields.  The time of parallelSort with a comparator that compares the fields one at a time is printed for comparison.  For verification,
+// the result is compared to the reference sorted with std::stable_sort and the field comparator, since records with equal keys keep their order.
+class compositeKeySortCase : SortCase {
+
+  struct event {
+    int32_t tenant;
+    int64_t timestamp;
+    uint16_t seq;
+    uint32_t id;
+  };
+
+  static bool eventLess(const event& a, const event& b) {
+    if (a.tenant != b.tenant) return a.tenant < b.tenant;
+    if (a.timestamp != b.timestamp) return a.timestamp > b.timestamp;
+    return a.seq < b.seq;
+  }
+
+  std::vector<event> source_data;
+  std::vector<event> test_data;
+
+public:
+  compositeKeySortCase() {
+  }
+
+  void generateData(size_t test_size, size_t data_type, unsigned int random_seed) {
+
+    source_data.resize(test_size);
+    RandomIntervalInt<int64_t> riTestData = RandomIntervalInt<int64_t>(-1000000LL, 1000000LL, random_seed);
+
+    // create the requested data type.
+    for (size_t i = 0; i < test_size; i++) {
+      int64_t r = data_type == dtRandom ? riTestData() : (data_type == dtOrdered ? (int64_t)i : (int64_t)(test_size - i));
+      switch (data_type) {
+      case dtRandom:
+      case dtOrdered:
+      case dtReverseOrdered: {
+        source_data[i].tenant = (int32_t)(r % 100);
+        source_data[i].timestamp = r / 100 * 7919 - 1000000;
+        source_data[i].seq = (uint16_t)(r * 31);
+        source_data[i].id = (uint32_t)i;
+        break;
+      }
+      default: {
+        std::cout << "No such data type: " << data_type << std::endl;
+        exit(1);
+      }
+      }
+    }
+  }
+
+  double runSort(size_t, size_t threads) {
+    test_data = source_data;
+    auto start = std::chrono::high_resolution_clock::now();
+    parallelSort(test_data.begin(), test_data.end(), eventLess, threads);
+    auto stop = std::chrono::high_resolution_clock::now();
+    std::cout << "  parallelSort with a field comparator: " << std::fixed << std::setprecision(5)
+      << std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count() / 1000000.0 << " seconds" << std::endl;
+
+    test_data = source_data;
+    start = std::chrono::high_resolution_clock::now();
+    parallelSortByKey(test_data.begin(), test_data.end(), [](const event& e) {
+      return keyBuilder<2>().add(e.tenant).add(e.timestamp, true).add(e.seq).key();
+      }, threads);
+    stop = std::chrono::high_resolution_clock::now();
+
+    // calculate and return the execution time.
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
+    return (duration.count() / 1000000.0);
+  }
+
+  bool verifySort(size_t test_size) {
+
+    // generate the reference data
+    std::vector<event> reference(source_data);
+    std::stable_sort(reference.begin(), reference.end(), eventLess);
+    for (size_t i = 0; i < test_size; i++) {
+      if (test_data[i].id != reference[i].id) {
+        std::cout << "parallelSortByKey record " << i << " is " << test_data[i].id << " instead of " << reference[i].id << std::endl;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void cleanup() {
+    source_data.clear();
+    test_data.clear();
+  }
+
+};
+
+// This is the test case for sort test #17.  It sorts 100 byte records, each a 16 bit tag and a 10 byte key followed by a payload, with sortRecords
+// and a key description given at run time: the tag descending and then the key bytes.  The time of parallelSort of the same records as a struct with
+// a compiled comparator is printed for comparison.  For verification, the result is compared to the reference sorted with std::stable_sort and the
+// compiled comparator, since records with equal keys keep their order.  The tags are drawn from a small range so that many records tie on them.
+class recordSortCase : SortCase {
+
+  struct record {
+    uint16_t tag;
+    unsigned char key[10];
+    uint32_t id;
+    unsigned char payload[84];
+  };
+
+  static bool recordLess(const record& a, const record& b) {
+    if (a.tag != b.tag) return a.tag > b.tag;
+    return memcmp(a.key, b.key, sizeof(a.key)) < 0;
+  }
+
+  std::vector<record> source_data;
+  std::vector<record> test_data;
+
+public:
+  recordSortCase() {
+  }
+
+  void generateData(size_t test_size, size_t data_type, unsigned int random_seed) {
+
+    source_data.resize(test_size);
+    RandomIntervalInt<int64_t> riTestData = RandomIntervalInt<int64_t>(0LL, 0xFFFFFFFFFFFFLL, random_seed);
+
+    // create the requested data type.
+    for (size_t i = 0; i < test_size; i++) {
+      record& r = source_data[i];
+      int64_t v;
+      switch (data_type) {
+      case dtRandom: { v = riTestData(); break; }
+      case dtOrdered: { v = (int64_t)i; break; }
+      case dtReverseOrdered: { v = (int64_t)(test_size - i); break; }
+      default: {
+        std::cout << "No such data type: " << data_type << std::endl;
+        exit(1);
+      }
+      }
+      r.tag = (uint16_t)(v % 16);
+      for (int b = 0; b < 10; b++) r.key[b] = (unsigned char)((v >> (40 - 5 * b)) & 0xFF);
+      r.id = (uint32_t)i;
+      memset(r.payload, (int)(i & 0xFF), sizeof(r.payload));
+    }
+  }
+
+  double runSort(size_t test_size, size_t threads) {
+    test_data = source_data;
+    auto start = std::chrono::high_resolution_clock::now();
+    parallelSort(test_data.begin(), test_data.end(), recordLess, threads);
+    auto stop = std::chrono::high_resolution_clock::now();
+    std::cout << "  parallelSort with a compiled comparator: " << std::fixed << std::setprecision(5)
+      << std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count() / 1000000.0 << " seconds" << std::endl;
+
+    test_data = source_data;
+    const recordKey keys[] = { { offsetof(record, tag), 2, keyUnsigned, true }, { offsetof(record, key), 10, keyBytes, false } };
+    start = std::chrono::high_resolution_clock::now();
+    sortRecords(test_data.data(), test_size, sizeof(record), keys, 2, threads);
+    stop = std::chrono::high_resolution_clock::now();
+
+    // calculate and return the execution time.
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
+    return (duration.count() / 1000000.0);
+  }
+
+  bool verifySort(size_t test_size) {
+
+    // generate the reference data
+    std::vector<record> reference(source_data);
+    std::stable_sort(reference.begin(), reference.end(), recordLess);
+    for (size_t i = 0; i < test_size; i++) {
+      if (memcmp(&test_data[i], &reference[i], sizeof(record)) != 0) {
+        std::cout << "sortRecords record " << i << " is " << test_data[i].id << " instead of " << reference[i].id << std::endl;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void cleanup() {
+    source_data.clear();
+    test_data.clear();
+  }
+
+};
+
+// This is the test case for sort test #18.  It sorts strings stored Arrow style, one buffer of bytes and an array of offsets, with parallelSortVarLen,
+// which writes a new buffer and offsets in sorted order.  The strings are 0 to 24 characters long from a 4 letter alphabet, so that many share their
+// first 8 bytes.  The time of parallelSort of the same strings as a std::vector<std::string> is printed for comparison, and so is the time of
+// parallelSortVarLenIndices.  For verification, the result is compared to the reference sorted with std::stable_sort, and the indices must point
+// to the reference strings in order with equal strings in increasing position.
+class varLenSortCase : SortCase {
+
+  std::vector<char> data;
+  std::vector<int64_t> offsets;
+  std::vector<unsigned char> sortedData;
+  std::vector<int64_t> sortedOffsets;
+  std::vector<size_t> indices;
+
+  std::string value(size_t i) { return std::string(data.data() + offsets[i], (size_t)(offsets[i + 1] - offsets[i])); }
+
+public:
+  varLenSortCase() {
+  }
+
+  void generateData(size_t test_size, size_t data_type, unsigned int random_seed) {
+
+    RandomIntervalInt<int64_t> riTestData = RandomIntervalInt<int64_t>(0, 1LL << 50, random_seed);
+    data.clear();
+    offsets.assign(1, 0);
+
+    // create the requested data type.  Ordered data counts up in base 4 with the strings padded to 12 letters.
+    for (size_t i = 0; i < test_size; i++) {
+      switch (data_type) {
+      case dtRandom: {
+        int64_t r = riTestData();
+        size_t len = (size_t)(r % 25);
+        r /= 25;
+        for (size_t c = 0; c < len; c++) data.push_back("acgt"[(r >> (2 * (c % 20))) & 3]);
+        break;
+      }
+      case dtOrdered:
+      case dtReverseOrdered: {
+        size_t v = data_type == dtOrdered ? i : test_size - i;
+        for (int c = 11; c >= 0; c--) data.push_back("acgt"[(v >> (2 * c)) & 3]);
+        break;
+      }
+      default: {
+        std::cout << "No such data type: " << data_type << std::endl;
+        exit(1);
+      }
+      }
+      offsets.push_back((int64_t)data.size());
+    }
+  }
+
+  double runSort(size_t test_size, size_t threads) {
+    std::vector<std::string> strings(test_size);
+    for (size_t i = 0; i < test_size; i++) strings[i] = value(i);
+    auto start = std::chrono::high_resolution_clock::now();
+    parallelSort(strings.begin(), strings.end(), std::less<std::string>(), threads);
+    auto stop = std::chrono::high_resolution_clock::now();
+    std::cout << "  parallelSort of std::string: " << std::fixed << std::setprecision(5)
+      << std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count() / 1000000.0 << " seconds" << std::endl;
+
+    start = std::chrono::high_resolution_clock::now();
+    parallelSortVarLenIndices(data.data(), offsets.data(), test_size, indices, threads);
+    stop = std::chrono::high_resolution_clock::now();
+    std::cout << "  parallelSortVarLenIndices: " << std::fixed << std::setprecision(5)
+      << std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count() / 1000000.0 << " seconds" << std::endl;
+
+    start = std::chrono::high_resolution_clock::now();
+    parallelSortVarLen(data.data(), offsets.data(), test_size, sortedData, sortedOffsets, threads);
+    stop = std::chrono::high_resolution_clock::now();
+
+    // calculate and return the execution time.
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
+    return (duration.count() / 1000000.0);
+  }
+
+  bool verifySort(size_t test_size) {
+
+    // generate the reference data
+    std::vector<size_t> reference(test_size);
+    for (size_t i = 0; i < test_size; i++) reference[i] = i;
+    std::stable_sort(reference.begin(), reference.end(), [this](size_t a, size_t b) { return value(a) < value(b); });
+    bool failed = sortedOffsets.size() != test_size + 1 || indices != reference;
+    for (size_t i = 0; i < test_size && !failed; i++) {
+      failed = value(reference[i]) != std::string((const char*)sortedData.data() + sortedOffsets[i], (size_t)(sortedOffsets[i + 1] - sortedOffsets[i]));
+    }
+    if (failed) std::cout << "parallelSortVarLen or parallelSortVarLenIndices did not give the sorted order" << std::endl;
+    return failed;
+  }
+
+  void cleanup() {
+    data.clear();
+    offsets.clear();
+    sortedData.clear();
+    sortedOffsets.clear();
+    indices.clear();
+  }
+
+};
+
+// This is the test case for sort test #19.  It sorts each group of 16 consecutive integers of an array with parallelSortGroups, which sorts every group
+// with a sorting network.  The data is generated in source_data[] like test #1, with the test size rounded down to whole groups.  The time of
+// parallelSegmentedSort of the same groups is printed for comparison.  For verification, each group of the reference is sorted with std::sort.
+class groupSortCase : SortCase {
+
+  static const size_t groupSize = 16;
+  int64_t* source_data = nullptr;
+  int64_t* test_data = nullptr;
+
+public:
+  groupSortCase() {
+  }
+
+  void generateData(size_t test_size, size_t data_type, unsigned int random_seed) {
+
+    if (source_data != nullptr) delete[] source_data;
+    source_data = new int64_t[test_size];
+    if (test_data != nullptr) delete[] test_data;
+    test_data = new  int64_t[test_size];
+    RandomIntervalInt<int64_t> riTestData = RandomIntervalInt<int64_t>(-10000000000LL, 10000000000LL, random_seed);
+
+    // create the requested data type.
+    switch (data_type) {
+    case dtRandom: { // generate random data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = riTestData();
+      break;
+    }
+    case dtOrdered: {  // generate ordered data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = (i);
+      break;
+    }
+    case dtReverseOrdered: { // generate reverse ordered data
+      for (size_t i = 0; i < test_size; i++) source_data[i] = (test_size - i);
+      break;
+    }
+    default: {
+      std::cout << "No such data type: " << data_type << std::endl;
+      exit(1);
+    }
+    }
+  }
+
+  double runSort(size_t test_size, size_t threads) {
+    const size_t groups = test_size / groupSize;
+    std::vector<size_t> offsets(groups + 1);
+    for (size_t g = 0; g <= groups; g++) offsets[g] = g * groupSize;
+    memcpy(test_data, source_data, test_size * sizeof(int64_t));
+    auto start = std::chrono::high_resolution_clock::now();
+    parallelSegmentedSort(test_data, offsets, threads);
+    auto stop = std::chrono::high_resolution_clock::now();
+    std::cout << "  parallelSegmentedSort: " << std::fixed << std::setprecision(5)
+      << std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count() / 1000000.0 << " seconds" << std::endl;
+
+    memcpy(test_data, source_data, test_size * sizeof(int64_t));
+    start = std::chrono::high_resolution_clock::now();
+    parallelSortGroups<groupSize>(test_data, groups, threads);
+    stop = std::chrono::high_resolution_clock::now();
+
+    // calculate and return the execution time.
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
+    return (duration.count() / 1000000.0);
+  }
+
+  bool verifySort(size_t test_size) {
+
+    // generate the reference data
+    std::vector<int64_t> reference(source_data, source_data + test_size);
+    const size_t whole = test_size / groupSize * groupSize;
+    for (size_t g = 0; g < whole; g += groupSize) std::sort(reference.begin() + g, reference.begin() + g + groupSize);
+    return sortVerifier(test_data, reference.data(), test_size);
+  }
+
+  void cleanup() {
+    delete[] source_data;
+    delete[] test_data;
+    source_data = nullptr;
+    test_data = nullptr;
+  }
+
+};
+
+// This is the test case for sort test #20.  It sorts strings of very different lengths with parallelSortWeighted, weighted by their lengths.
+// 90% of the strings are 3 to 30 random letters, and 10% are 300 to 3000 bytes that start with the same 256 letter prefix, so their comparisons
+// are long and they all end up together at the end of the sorted order.  The time of parallelSort of the same strings is printed for comparison.
+// For verification, the result is compared to the reference sorted with std::sort.
+class skewedStringSortCase : SortCase {
+
+  std::vector<std::string> source;
+  std::vector<std::string> strings;
+
+public:
+  skewedStringSortCase() {
+  }
+
+  void generateData(size_t test_size, size_t data_type, unsigned int random_seed) {
+
+    RandomIntervalInt<int64_t> riTestData = RandomIntervalInt<int64_t>(0, 1LL << 50, random_seed);
+    const std::string prefix(256, 'z');
+    source.resize(test_size);
+    for (size_t i = 0; i < test_size; i++) {
+      int64_t r = riTestData();
+      std::string& s = source[i];
+      if (r % 10 == 0) {
+        s = prefix;
+        s.resize(300 + (size_t)(r / 10 % 2701), 'a');
+      }
+      else s.resize(3 + (size_t)(r / 10 % 28));
+      for (size_t c = s[0] == 'z' ? prefix.size() : 0; c < s.size(); c++) s[c] = (char)('a' + riTestData() % 26);
+    }
+
+    // create the requested data type.
+    switch (data_type) {
+    case dtRandom: break;
+    case dtOrdered: std::sort(source.begin(), source.end()); break;
+    case dtReverseOrdered: std::sort(source.begin(), source.end(), std::greater<std::string>()); break;
+    default: {
+      std::cout << "No such data type: " << data_type << std::endl;
+      exit(1);
+    }
+    }
+  }
+
+  double runSort(size_t, size_t threads) {
+    strings = source;
+    auto start = std::chrono::high_resolution_clock::now();
+    parallelSort(strings.begin(), strings.end(), std::less<std::string>(), threads);
+    auto stop = std::chrono::high_resolution_clock::now();
+    std::cout << "  parallelSort: " << std::fixed << std::setprecision(5)
+      << std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count() / 1000000.0 << " seconds" << std::endl;
+
+    strings = source;
+    start = std::chrono::high_resolution_clock::now();
+    parallelSortWeighted(strings.begin(), strings.end(), std::less<std::string>(), [](const std::string& s) { return s.size(); }, threads);
+    stop = std::chrono::high_resolution_clock::now();
+
+    // calculate and return the execution time.
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
+    return (duration.count() / 1000000.0);
+  }
+
+  bool verifySort(size_t) {
+    std::vector<std::string> reference(source);
+    std::sort(reference.begin(), reference.end());
+    bool failed = strings != reference;
+    if (failed) std::cout << "parallelSortWeighted did not give the sorted order" << std::endl;
+    return failed;
+  }
+
+  void cleanup() {
+    source.clear();
+    strings.clear();
+  }
+};
+
+// This is the test case for sort test #21.  It sorts a copy of an array of 16 byte records, compared by their first 8 bytes, with parallelSortCopy,
+// which leaves the source as it is.  The time of a copy followed by parallelSort, which is how tests #1 and #2 keep their source data, is printed
+// for comparison.  For verification, the source must be unchanged and the result must match the reference sorted with std::stable_sort.
+class copySortCase : SortCase {
+
+  struct keyValue {
+    int64_t key;
+    int64_t value;
+  };
+  static bool keyLess(const keyValue& a, const keyValue& b) { return a.key < b.key; }
+
+  std::vector<keyValue> source;
+  std::vector<keyValue> original;
+  std::vector<keyValue> sorted;
+
+public:
+  copySortCase() {
+  }
+
+  void generateData(size_t test_size, size_t data_type, unsigned int random_seed) {
+
+    RandomIntervalInt<int64_t> riTestData = RandomIntervalInt<int64_t>(-10000000000LL, 10000000000LL, random_seed);
+    source.resize(test_size);
+
+    // create the requested data type.
+    for (size_t i = 0; i < test_size; i++) {
+      switch (data_type) {
+      case dtRandom: source[i].key = riTestData(); break;
+      case dtOrdered: source[i].key = (int64_t)i; break;
+      case dtReverseOrdered: source[i].key = (int64_t)(test_size - i); break;
+      default: {
+        std::cout << "No such data type: " << data_type << std::endl;
+        exit(1);
+      }
+      }
+      source[i].value = (int64_t)i;
+    }
+    original = source;
+    sorted.assign(test_size, keyValue());
+  }
+
+  double runSort(size_t test_size, size_t threads) {
+    auto start = std::chrono::high_resolution_clock::now();
+    memcpy(sorted.data(), source.data(), test_size * sizeof(keyValue));
+    parallelSort(sorted.begin(), sorted.end(), keyLess, threads);
+    auto stop = std::chrono::high_resolution_clock::now();
+    std::cout << "  copy and parallelSort: " << std::fixed << std::setprecision(5)
+      << std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count() / 1000000.0 << " seconds" << std::endl;
+
+    start = std::chrono::high_resolution_clock::now();
+    parallelSortCopy(source.cbegin(), source.cend(), sorted.begin(), keyLess, threads);
+    stop = std::chrono::high_resolution_clock::now();
+
+    // calculate and return the execution time.
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
+    return (duration.count() / 1000000.0);
+  }
+
+  bool verifySort(size_t test_size) {
+    std::vector<keyValue> reference(original);
+    std::stable_sort(reference.begin(), reference.end(), keyLess);
+    bool failed = false;
+    for (size_t i = 0; i < test_size && !failed; i++) {
+      failed = sorted[i].key != reference[i].key || source[i].key != original[i].key || source[i].value != original[i].value;
+    }
+    if (failed) std::cout << "parallelSortCopy did not give the sorted order or changed the source" << std::endl;
+    return failed;
+  }
+
+  void cleanup() {
+    source.clear();
+    original.clear();
+    sorted.clear();
+  }
+};
+
+// documentation of program arguments;
+void printHelp() {
+  std::cout << "Usage:\n";
+  std::cout << "ParallelSortTest [-t <test number>] [-n <test_size> | -rs] [-minT <min threads>] [-maxT <max threads>] [-l <num tests per thread>] [-dr | -do | db] [-v | -nv]\n";
+  std::cout << "  -t <test number> indicates test to run\n";
+  std::cout << "     1 = sort array integers, 2 = sort std::vector of integers, 3 = sort vector of pointers to strings.  Default = 1\n";
+  std::cout << "     4 = <threads> concurrent callers each sorting an array of integers with the default thread count\n";
+  std::cout << "     5 = foreground latency while sorting an array of integers\n";
+  std::cout << "     6 = sort array integers with parallelSortAsync while the caller does other work\n";
+  std::cout << "     7 = sort array integers with each executor backend\n";
+  std::cout << "     8 = sort array integers with psort::sort and psort::stable_sort and their std::execution::par equivalents\n";
+  std::cout << "     9 = sort many independent segments of integers with parallelSegmentedSort\n";
+  std::cout << "    10 = sort array integers while counting the threads parallelSort runs\n";
+  std::cout << "    11 = partition array integers into -buckets key-range buckets with parallelPartitionBySplitters\n";
+  std::cout << "    12 = sort array integers from 0 to 255, which parallelSort counts instead of sorting\n";
+  std::cout << "    13 = sort array integers with a 32 bit range, which parallelSort sorts as narrow keys\n";
+  std::cout << "    14 = sort array doubles with -nans percent NaNs, 15 = the same with floats\n";
+  std::cout << "    16 = sort records by a composite key with parallelSortByKey\n";
+  std::cout << "    17 = sort 100 byte records described at run time with sortRecords\n";
+  std::cout << "    18 = sort strings stored as a buffer and offsets with parallelSortVarLen\n";
+  std::cout << "    19 = sort each group of 16 integers of an array with parallelSortGroups\n";
+  std::cout << "    20 = sort strings of 3 to 3000 bytes with parallelSortWeighted, weighted by length\n";
+  std::cout << "    21 = sort a copy of an array of 16 byte records with parallelSortCopy\n";
+  std::cout << "  -n <test size>: number of elements to sort on each test loop.\n";
+  std::cout << "  -rs: randomize the test size.  Default \n";
+  std::cout << "  -minT <min Threads>\n";
+  std::cout << "  -maxT <max Threads> minT and maxT set the minimum and maximum threads the program will loop over.  Defaults are 1 and 8 \n";
+  std::cout << "  -l <num tests per thread> sets tnu number of tests that will be run for each thread\n";
+  std::cout << "  -dr | do | -db set the type of data for each test; random or ordered or reverse ordered respectively.  Default is -dr\n";
+  std::cout << "  -v or -nv indicate whether to verify the sort  Default is -v\n";
+  std::cout << "  -g <random generator seed> used to vary the random numbers.  Default is 1.\n";
+  std::cout << "  -bg [-mm <max merge tasks>] runs test 5 with parallelSortBackground, optionally limiting the concurrent merge tasks.\n";
+  std::cout << "  -nogov turns off the concurrencyGovernor that shares threads between simultaneous parallelSort calls.\n";
+  std::cout << "  -prefetch <distance> sets how far ahead merges of pointers prefetch, 0 for none.  Default is 8.\n";
+  std::cout << "  -nostream turns off the merges with non-temporal stores used for merges larger than mergeStreamBytes().\n";
+  std::cout << "  -buckets <buckets> sets the number of buckets of test 11.  Default is 256.\n";
+  std::cout << "  -nans <percent> sets the percentage of NaNs in tests 14 and 15.  Default is 1.\n";
+}
+
+
+int main(int argc, char* argv[]) {
+
+  // default settings
+  bool fixedTestSize = false;
+  size_t fixedTestSizeNum = 1024 * 1024 * 16;
+  size_t minThreads = 1;
+  size_t maxThreads = 8;
+  bool verifySort = true;
+  size_t sortTestSel = 1;
+  size_t num_tests = 25;
+  size_t dataType = dtRandom;
+  int64_t random_seed = 1;
+  bool backgroundSort = false;
+  size_t maxMergeTasks = 0;
+  size_t buckets = 256;
+  double nanPercent = 1.0;
+
+  // parse the program arguments
+  bool argError = false;
+  for (size_t arg = 1; arg < argc; arg++) {
+    bool oneMore = arg < (argc - 1);
+    if (strcmp(argv[arg], "-minT") == 0) {
+      arg++;
+      if (!oneMore || 0 == (minThreads = atoi(argv[arg]))) {
+        std::cout << "-minT requires a non-zero integer argument." << std::endl;
+        argError = true;
+      }
+    }
+    else if (strcmp(argv[arg], "-maxT") == 0) {
+      arg++;
+      if (!oneMore || 0 == (maxThreads = atoi(argv[arg]))) {
+        std::cout << "-maxT requires a non-zero integer argument." << std::endl;
+        argError = true;
+      }
+    }
+    else if (strcmp(argv[arg], "-n") == 0) {
+      arg++;
+      if (!oneMore || 0 == (fixedTestSizeNum = atoi(argv[arg]))) {
+        std::cout << "-n requires a non-zero integer argument." << std::endl;
+        argError = true;
+      }
+      fixedTestSize = true;
+    }
+    else if (strcmp(argv[arg], "-t") == 0) {
+      arg++;
+      if (!oneMore || 0 == (sortTestSel = atoi(argv[arg]))) {
+        std::cout << "-t requires a non-zero integer argument." << std::endl;
+        argError = true;
+      }
+    }
+    else if (strcmp(argv[arg], "-l") == 0) {
+      arg++;
+      if (!oneMore || 0 == (num_tests = atoi(argv[arg]))) {
+        std::cout << "-l requires a non-zero integer argument." << std::endl;
+        argError = true;
+      }
+    }
+    else if (strcmp(argv[arg], "-g") == 0) {
+      arg++;
+      if (!oneMore || 0 == (random_seed = atoi(argv[arg]))) {
+        std::cout << "-g requires a non-zero integer argument." << std::endl;
+        argError = true;
+      }
+    }
+    else if (strcmp(argv[arg], "-rs") == 0) {
+      fixedTestSize = false;
+    }
+    else if (strcmp(argv[arg], "-dr") == 0) {
+      dataType = dtRandom;
+    }
+    else if (strcmp(argv[arg], "-do") == 0) {
+      dataType = dtOrdered;
+    }
+    else if (strcmp(argv[arg], "-db") == 0) {
+      dataType = dtReverseOrdered;
+    }
+    else if (strcmp(argv[arg], "-nv") == 0) {
+      verifySort = false;
+    }
+    else if (strcmp(argv[arg], "-v") == 0) {
+      verifySort = true;
+    }
+    else if (strcmp(argv[arg], "-bg") == 0) {
+      backgroundSort = true;
+    }
+    else if (strcmp(argv[arg], "-mm") == 0) {
+      arg++;
+      if (!oneMore || 0 == (maxMergeTasks = atoi(argv[arg]))) {
+        std::cout << "-mm requires a non-zero integer argument." << std::endl;
+        argError = true;
+      }
+    }
+    else if (strcmp(argv[arg], "-buckets") == 0) {
+      arg++;
+      if (!oneMore || 0 == (buckets = atoi(argv[arg]))) {
+        std::cout << "-buckets requires a non-zero integer argument." << std::endl;
+        argError = true;
+      }
+    }
+    else if (strcmp(argv[arg], "-nans") == 0) {
+      arg++;
+      if (!oneMore || (nanPercent = atof(argv[arg])) < 0.0 || nanPercent > 100.0) {
+        std::cout << "-nans requires a percentage from 0 to 100." << std::endl;
+        argError = true;
+      }
+    }
+    else if (strcmp(argv[arg], "-nogov") == 0) {
+      globalConcurrencyGovernor().setEnabled(false);
+    }
+    else if (strcmp(argv[arg], "-prefetch") == 0) {
+      arg++;
+      if (!oneMore) {
+        std::cout << "-prefetch requires a distance." << std::endl;
+        argError = true;
+      }
+      else mergePrefetchDistance() = atoi(argv[arg]);
+    }
+    else if (strcmp(argv[arg], "-nostream") == 0) {
+      mergeStreamBytes() = SIZE_MAX;
+    }
+    else if (strcmp(argv[arg], "-h") == 0) {
+      printHelp();
+      return(0);
+    }
+    else {
+      std::cout << "Argument " << argv[arg] << " not recognized" << std::endl;
+      printHelp();
+      argError = true;
+    }
+  }
+  if (argError) {
+    return 1;
+  }
+
+  // print out the data type part of the output header
+  switch (dataType) {
+  case dtRandom: {
+    std::cout << "Random data: "; break;
+  }
+  case dtOrdered: {
+    std::cout << "Ordered data: "; break;
+  }
+  case dtReverseOrdered: {
+    std::cout << "ReverseOrdered data: "; break;
+  }
+  default: {
+    std::cout << "No such data type: " << dataType << std::endl;
+    exit(1);
+  }
+  }
+
+  // print out the test case part of the program header and set the test case.
+  SortCase* sortCase = nullptr;
+  switch (sortTestSel) {
+  case 1: {
+    std::cout << "Sort Test Case " << sortTestSel << ", array default direction" << std::endl;
+    sortCase = (SortCase*)new arraySortCase();
+    break;
+  }
+  case 2: {
+    std::cout << "Sort Test Case " << sortTestSel << ", vector largest to smallest" << std::endl;
+    sortCase = (SortCase*)new vectorSortCase();
+    break;
   }
   case 3: {
     std::cout << "Sort Test Case " << sortTestSel << ", pointers to strings smallest to largest" << std::endl;
     sortCase = (SortCase*)new textPointerSortCase();
     break;
   }
+  case 4: {
+    std::cout << "Sort Test Case " << sortTestSel << ", concurrent callers sorting arrays with the default thread count" << std::endl;
+    sortCase = (SortCase*)new concurrentCallersSortCase();
+    break;
+  }
+  case 5: {
+    std::cout << "Sort Test Case " << sortTestSel << ", foreground latency while sorting an array" << (backgroundSort ? " in the background" : "") << std::endl;
+    sortCase = (SortCase*)new foregroundLatencySortCase(backgroundSort, maxMergeTasks);
+    break;
+  }
+  case 6: {
+    std::cout << "Sort Test Case " << sortTestSel << ", array sorted asynchronously on the thread pool" << std::endl;
+    sortCase = (SortCase*)new asyncSortCase();
+    break;
+  }
+  case 7: {
+    std::cout << "Sort Test Case " << sortTestSel << ", array sorted with each executor backend" << std::endl;
+    sortCase = (SortCase*)new executorSortCase();
+    break;
+  }
+  case 8: {
+    std::cout << "Sort Test Case " << sortTestSel << ", array sorted with execution policies" << std::endl;
+    sortCase = (SortCase*)new policySortCase();
+    break;
+  }
+  case 9: {
+    std::cout << "Sort Test Case " << sortTestSel << ", segmented sort of independent arrays" << std::endl;
+    sortCase = (SortCase*)new segmentedSortCase();
+    break;
+  }
+  case 10: {
+    std::cout << "Sort Test Case " << sortTestSel << ", thread budget of parallelSort" << std::endl;
+    sortCase = (SortCase*)new threadBudgetSortCase();
+    break;
+  }
+  case 11: {
+    std::cout << "Sort Test Case " << sortTestSel << ", partition into " << buckets << " buckets" << std::endl;
+    sortCase = (SortCase*)new partitionSortCase(buckets);
+    break;
+  }
+  case 12: {
+    std::cout << "Sort Test Case " << sortTestSel << ", counting sort of a small range of integers" << std::endl;
+    sortCase = (SortCase*)new countingSortCase();
+    break;
+  }
+  case 13: {
+    std::cout << "Sort Test Case " << sortTestSel << ", narrow key sort of integers with a 32 bit range" << std::endl;
+    sortCase = (SortCase*)new narrowKeySortCase();
+    break;
+  }
+  case 14: {
+    std::cout << "Sort Test Case " << sortTestSel << ", doubles with " << nanPercent << "% NaNs" << std::endl;
+    sortCase = (SortCase*)new floatSortCase<double>(nanPercent);
+    break;
+  }
+  case 15: {
+    std::cout << "Sort Test Case " << sortTestSel << ", floats with " << nanPercent << "% NaNs" << std::endl;
+    sortCase = (SortCase*)new floatSortCase<float>(nanPercent);
+    break;
+  }
+  case 16: {
+    std::cout << "Sort Test Case " << sortTestSel << ", records sorted by a normalized composite key" << std::endl;
+    sortCase = (SortCase*)new compositeKeySortCase();
+    break;
+  }
+  case 17: {
+    std::cout << "Sort Test Case " << sortTestSel << ", 100 byte records with a key described at run time" << std::endl;
+    sortCase = (SortCase*)new recordSortCase();
+    break;
+  }
+  case 18: {
+    std::cout << "Sort Test Case " << sortTestSel << ", strings stored as a buffer and offsets" << std::endl;
+    sortCase = (SortCase*)new varLenSortCase();
+    break;
+  }
+  case 19: {
+    std::cout << "Sort Test Case " << sortTestSel << ", groups of 16 integers sorted with sorting networks" << std::endl;
+    sortCase = (SortCase*)new groupSortCase();
+    break;
+  }
+  case 20: {
+    std::cout << "Sort Test Case " << sortTestSel << ", strings of skewed lengths sorted with parallelSortWeighted" << std::endl;
+    sortCase = (SortCase*)new skewedStringSortCase();
+    break;
+  }
+  case 21: {
+    std::cout << "Sort Test Case " << sortTestSel << ", a copy of an array of records sorted with parallelSortCopy" << std::endl;
+    sortCase = (SortCase*)new copySortCase();
+    break;
+  }
   default: {
     std::cout << "No such test case: " << sortTestSel << std::endl;
     exit(1);
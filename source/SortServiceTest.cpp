@@ -0,0 +1,148 @@
+// SortServiceTest.cpp : runs the sort service daemon or benchmarks it against in-process parallelSort calls.
+//
+
+/**
+* Copyright(c) 2023 John Robinson.
+*
+*SPDX - License - Identifier: BSD - 3 - Clause
+*/
+
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <vector>
+#include <cstring>
+#include <iomanip>
+#include <csignal>
+#include <sys/wait.h>
+#include "sortService.hpp"
+
+// documentation of program arguments;
+void printHelp() {
+  std::cout << "Usage:\n";
+  std::cout << "SortServiceTest [-daemon] [-s <socket path>] [-threads <daemon threads>] [-c <clients>] [-n <elements>] [-l <sorts per client>] [-small <batch limit>]\n";
+  std::cout << "  -daemon: only run the sort service daemon on the socket until killed.\n";
+  std::cout << "           Without -daemon, a daemon is forked and benchmarked against in-process parallelSort calls.\n";
+  std::cout << "  -s <socket path>: Unix-domain socket of the daemon.  Default is /tmp/psort.service\n";
+  std::cout << "  -threads <daemon threads>: sorting threads in the daemon.  Default is 0 = hardware_concurrency\n";
+  std::cout << "  -c <clients>: number of concurrent client threads.  Default is 16\n";
+  std::cout << "  -n <elements>: maximum int64_t elements per request, sizes are random up to this.  Default is 10000\n";
+  std::cout << "  -l <sorts per client>: requests each client makes.  Default is 1000\n";
+  std::cout << "  -small <batch limit>: requests smaller than this are batched by the daemon.  Default is 65536\n";
+}
+
+// run clients threads that each sort loops random arrays with sortFn and print throughput and latency percentiles.
+template<class SF>
+void runClients(const char* name, size_t clients, size_t maxN, size_t loops, SF sortFn) {
+  std::vector<std::vector<double>> latencies(clients);
+  std::atomic<size_t> elements{ 0 };
+  std::atomic<size_t> failures{ 0 };
+  auto start = std::chrono::high_resolution_clock::now();
+  std::vector<std::thread> threads;
+  for (size_t c = 0; c < clients; c++) {
+    threads.emplace_back([&, c]() {
+      auto sorter = sortFn();
+      std::mt19937_64 gen(c + 1);
+      std::uniform_int_distribution<size_t> sizeDist(1, maxN);
+      std::uniform_int_distribution<int64_t> valDist(-10000000000LL, 10000000000LL);
+      std::vector<int64_t> data;
+      for (size_t l = 0; l < loops; l++) {
+        data.resize(sizeDist(gen));
+        for (auto& v : data) v = valDist(gen);
+        auto t0 = std::chrono::high_resolution_clock::now();
+        sorter(data.data(), data.size());
+        auto t1 = std::chrono::high_resolution_clock::now();
+        latencies[c].push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / 1000.0);
+        if (!std::is_sorted(data.begin(), data.end())) failures++;
+        elements += data.size();
+      }
+      });
+  }
+  for (auto& t : threads) t.join();
+  auto stop = std::chrono::high_resolution_clock::now();
+  double seconds = std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count() / 1000000.0;
+
+  std::vector<double> all;
+  for (auto& l : latencies) all.insert(all.end(), l.begin(), l.end());
+  std::sort(all.begin(), all.end());
+  auto pct = [&all](double p) { return all[minimum(all.size() - 1, (size_t)(p * all.size()))]; };
+  std::cout << std::fixed << std::setprecision(1) << std::setw(12) << name << ": "
+    << std::setw(10) << all.size() / seconds << " sorts/s, " << std::setw(8) << elements / seconds / 1.0e6 << " M elements/s, latency us p50 = "
+    << pct(0.50) << " p90 = " << pct(0.90) << " p99 = " << pct(0.99) << " max = " << all.back();
+  if (failures > 0) std::cout << "  " << failures << " SORT FAILURES";
+  std::cout << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  bool daemonOnly = false;
+  std::string path = "/tmp/psort.service";
+  size_t daemonThreads = 0;
+  size_t clients = 16;
+  size_t maxN = 10000;
+  size_t loops = 1000;
+  size_t smallLimit = 65536;
+
+  for (int arg = 1; arg < argc; arg++) {
+    bool oneMore = arg < (argc - 1);
+    if (strcmp(argv[arg], "-daemon") == 0) daemonOnly = true;
+    else if (strcmp(argv[arg], "-s") == 0 && oneMore) path = argv[++arg];
+    else if (strcmp(argv[arg], "-threads") == 0 && oneMore) daemonThreads = atoi(argv[++arg]);
+    else if (strcmp(argv[arg], "-c") == 0 && oneMore) clients = atoi(argv[++arg]);
+    else if (strcmp(argv[arg], "-n") == 0 && oneMore) maxN = atoll(argv[++arg]);
+    else if (strcmp(argv[arg], "-l") == 0 && oneMore) loops = atoi(argv[++arg]);
+    else if (strcmp(argv[arg], "-small") == 0 && oneMore) smallLimit = atoll(argv[++arg]);
+    else if (strcmp(argv[arg], "-h") == 0) { printHelp(); return 0; }
+    else {
+      std::cout << "Argument " << argv[arg] << " not recognized" << std::endl;
+      printHelp();
+      return 1;
+    }
+  }
+  if (clients == 0 || maxN == 0 || loops == 0) {
+    printHelp();
+    return 1;
+  }
+
+  if (daemonOnly) {
+    sortServiceServer server(path, daemonThreads, smallLimit);
+    std::cout << "Sort service listening on " << path << std::endl;
+    server.run();
+    return 0;
+  }
+
+  // fork the daemon before this process starts any threads.
+  pid_t daemon = fork();
+  if (daemon == 0) {
+    sortServiceServer server(path, daemonThreads, smallLimit);
+    server.run();
+    _exit(0);
+  }
+  // wait until the daemon accepts connections.
+  for (int tries = 0; ; tries++) {
+    try {
+      sortServiceClient probe(path);
+      break;
+    }
+    catch (const std::exception& e) {
+      if (tries > 500) {
+        std::cout << e.what() << std::endl;
+        kill(daemon, SIGKILL);
+        return 1;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+
+  std::cout << clients << " clients each sorting " << loops << " int64_t arrays of 1 to " << maxN << " elements" << std::endl;
+  runClients("in-process", clients, maxN, loops, []() {
+    return [](int64_t* d, size_t n) { parallelSort(d, d + n); };
+    });
+  runClients("service", clients, maxN, loops, [&path]() {
+    auto client = std::make_shared<sortServiceClient>(path);
+    return [client](int64_t* d, size_t n) { client->sort(d, n); };
+    });
+
+  kill(daemon, SIGTERM);
+  waitpid(daemon, nullptr, 0);
+  return 0;
+}
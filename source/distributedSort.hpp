@@ -0,0 +1,392 @@
+/**
+* distributedSort.hpp
+*
+ * Copyright (c) 2023 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef DISTRIBUTEDSORT_HPP
+#define DISTRIBUTEDSORT_HPP
+
+// distributedSort spreads a sort over several cooperating processes (ranks).  It is a sample sort:
+// 1. Each rank sorts its local shard with parallelSort.
+// 2. Each rank takes regularly spaced samples of its sorted shard, all ranks exchange their samples
+//    and each one picks the same nranks-1 global splitters from the combined sample.
+// 3. Each rank cuts its sorted shard at the splitters and sends piece j to rank j (all-to-all).
+// 4. Each rank merges the nranks sorted pieces it received into its part of the global order.
+// After the sort, every element on rank r is ordered before every element on rank r+1.
+// The ranks talk over Unix-domain or TCP sockets so this code is POSIX only.  The element type must
+// be trivially copyable since elements are sent as raw bytes.
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <stdint.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "parallelSort.hpp"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// an endpoint is where one rank listens for connections from the other ranks.
+// A Unix-domain endpoint uses path, a TCP endpoint uses host and port.
+struct sortEndpoint {
+  bool isUnix = true;
+  std::string path;
+  std::string host;
+  uint16_t port = 0;
+};
+
+// endpoints for nranks ranks on this machine using Unix-domain sockets named <prefix>.<rank>
+inline std::vector<sortEndpoint> unixEndpoints(int nranks, const std::string& prefix) {
+  std::vector<sortEndpoint> eps(nranks);
+  for (int r = 0; r < nranks; r++) eps[r].path = prefix + "." + std::to_string(r);
+  return eps;
+}
+
+// endpoints for nranks ranks using TCP sockets at host:basePort+rank
+inline std::vector<sortEndpoint> tcpEndpoints(int nranks, const std::string& host, uint16_t basePort) {
+  std::vector<sortEndpoint> eps(nranks);
+  for (int r = 0; r < nranks; r++) {
+    eps[r].isUnix = false;
+    eps[r].host = host;
+    eps[r].port = (uint16_t)(basePort + r);
+  }
+  return eps;
+}
+
+// per phase wall clock times in seconds for one rank's part of a distributedSort
+struct distributedSortTimes {
+  double localSort = 0.0;
+  double splitters = 0.0;
+  double exchange = 0.0;
+  double merge = 0.0;
+};
+
+// sortComm holds a fully connected mesh of sockets between all the ranks.  Every rank constructs a
+// sortComm with the same endpoint list and its own rank number.  Each rank listens on its own endpoint,
+// connects to every lower numbered rank and accepts connections from every higher numbered rank.
+class sortComm {
+  int rank_;
+  int nranks_;
+  std::vector<int> fds_;  // socket to each peer, -1 for self
+  int listenFd_ = -1;
+  std::string unixPath_;
+
+  static void fail(const std::string& what) {
+    throw std::runtime_error("sortComm: " + what + ": " + strerror(errno));
+  }
+
+  static int openSocket(const sortEndpoint& ep, sockaddr_storage& addr, socklen_t& addrLen) {
+    memset(&addr, 0, sizeof(addr));
+    int fd;
+    if (ep.isUnix) {
+      sockaddr_un* ua = reinterpret_cast<sockaddr_un*>(&addr);
+      ua->sun_family = AF_UNIX;
+      if (ep.path.size() >= sizeof(ua->sun_path)) throw std::runtime_error("sortComm: socket path too long: " + ep.path);
+      strncpy(ua->sun_path, ep.path.c_str(), sizeof(ua->sun_path) - 1);
+      addrLen = sizeof(sockaddr_un);
+      fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    }
+    else {
+      sockaddr_in* ia = reinterpret_cast<sockaddr_in*>(&addr);
+      ia->sin_family = AF_INET;
+      ia->sin_port = htons(ep.port);
+      if (inet_pton(AF_INET, ep.host.c_str(), &ia->sin_addr) != 1) throw std::runtime_error("sortComm: bad host address: " + ep.host);
+      addrLen = sizeof(sockaddr_in);
+      fd = socket(AF_INET, SOCK_STREAM, 0);
+    }
+    if (fd < 0) fail("socket");
+    return fd;
+  }
+
+  static void tuneSocket(int fd, const sortEndpoint& ep) {
+    if (!ep.isUnix) {
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+  }
+
+public:
+  sortComm(const std::vector<sortEndpoint>& endpoints, int rank, double connectTimeout = 30.0)
+    : rank_(rank), nranks_((int)endpoints.size()), fds_(endpoints.size(), -1) {
+    if (rank < 0 || rank >= nranks_) throw std::runtime_error("sortComm: rank out of range");
+    if (nranks_ == 1) return;
+
+    // listen on this rank's endpoint.
+    const sortEndpoint& me = endpoints[rank];
+    sockaddr_storage addr;
+    socklen_t addrLen;
+    listenFd_ = openSocket(me, addr, addrLen);
+    if (me.isUnix) {
+      unlink(me.path.c_str());
+      unixPath_ = me.path;
+    }
+    else {
+      int one = 1;
+      setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    }
+    if (bind(listenFd_, reinterpret_cast<sockaddr*>(&addr), addrLen) != 0) fail("bind");
+    if (listen(listenFd_, nranks_) != 0) fail("listen");
+
+    // connect to the lower numbered ranks, retrying until they are listening.
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(connectTimeout);
+    for (int peer = 0; peer < rank; peer++) {
+      while (true) {
+        int fd = openSocket(endpoints[peer], addr, addrLen);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&addr), addrLen) == 0) {
+          tuneSocket(fd, endpoints[peer]);
+          int32_t id = rank;
+          sendBytes(fd, &id, sizeof(id));
+          fds_[peer] = fd;
+          break;
+        }
+        close(fd);
+        if (std::chrono::steady_clock::now() > deadline) fail("connect to rank " + std::to_string(peer));
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+    }
+    // accept the connections from the higher numbered ranks.  They identify themselves with their rank.
+    for (int n = rank + 1; n < nranks_; n++) {
+      int fd = accept(listenFd_, nullptr, nullptr);
+      if (fd < 0) fail("accept");
+      tuneSocket(fd, me);
+      int32_t id;
+      recvBytes(fd, &id, sizeof(id));
+      if (id <= rank || id >= nranks_ || fds_[id] != -1) throw std::runtime_error("sortComm: unexpected peer rank");
+      fds_[id] = fd;
+    }
+  }
+
+  ~sortComm() {
+    for (int fd : fds_) if (fd >= 0) close(fd);
+    if (listenFd_ >= 0) close(listenFd_);
+    if (!unixPath_.empty()) unlink(unixPath_.c_str());
+  }
+
+  sortComm(const sortComm&) = delete;
+  sortComm& operator=(const sortComm&) = delete;
+
+  int rank() const { return rank_; }
+  int size() const { return nranks_; }
+
+  static void sendBytes(int fd, const void* buf, size_t len) {
+    const char* p = static_cast<const char*>(buf);
+    while (len > 0) {
+      ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        fail("send");
+      }
+      p += n;
+      len -= n;
+    }
+  }
+
+  static void recvBytes(int fd, void* buf, size_t len) {
+    char* p = static_cast<char*>(buf);
+    while (len > 0) {
+      ssize_t n = recv(fd, p, len, 0);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        fail("recv");
+      }
+      if (n == 0) throw std::runtime_error("sortComm: peer closed connection");
+      p += n;
+      len -= n;
+    }
+  }
+
+  // allToAll sends sendBuf[sendOff[j] .. sendOff[j+1]) to rank j and returns what every rank sent to this one
+  // concatenated in rank order in recvBuf.  recvOff receives the nranks+1 offsets of each rank's piece.
+  // The exchange is done in nranks-1 steps.  In step s this rank sends to rank+s and receives from rank-s,
+  // with the send running on a separate thread so that two ranks sending large pieces to each other cannot deadlock.
+  template<class T>
+  void allToAll(const T* sendBuf, const std::vector<size_t>& sendOff, std::vector<T>& recvBuf, std::vector<size_t>& recvOff) {
+    static_assert(std::is_trivially_copyable<T>::value, "allToAll requires a trivially copyable type");
+    std::vector<uint64_t> sendCnt(nranks_), recvCnt(nranks_);
+    for (int j = 0; j < nranks_; j++) sendCnt[j] = sendOff[j + 1] - sendOff[j];
+    recvCnt[rank_] = sendCnt[rank_];
+    exchange([&](int peer) { return std::make_pair((const void*)&sendCnt[peer], sizeof(uint64_t)); },
+      [&](int peer) { return std::make_pair((void*)&recvCnt[peer], sizeof(uint64_t)); });
+
+    recvOff.assign(nranks_ + 1, 0);
+    for (int j = 0; j < nranks_; j++) recvOff[j + 1] = recvOff[j] + recvCnt[j];
+    recvBuf.resize(recvOff[nranks_]);
+    std::copy(sendBuf + sendOff[rank_], sendBuf + sendOff[rank_ + 1], recvBuf.begin() + recvOff[rank_]);
+    exchange([&](int peer) { return std::make_pair((const void*)(sendBuf + sendOff[peer]), sendCnt[peer] * sizeof(T)); },
+      [&](int peer) { return std::make_pair((void*)(recvBuf.data() + recvOff[peer]), recvCnt[peer] * sizeof(T)); });
+  }
+
+  // allGather sends the same buffer to every rank and returns every rank's buffer concatenated in rank order.
+  template<class T>
+  void allGather(const std::vector<T>& sendBuf, std::vector<T>& recvBuf, std::vector<size_t>& recvOff) {
+    std::vector<T> rep;
+    std::vector<size_t> sendOff(nranks_ + 1);
+    rep.reserve(sendBuf.size() * nranks_);
+    for (int j = 0; j < nranks_; j++) {
+      sendOff[j] = rep.size();
+      rep.insert(rep.end(), sendBuf.begin(), sendBuf.end());
+    }
+    sendOff[nranks_] = rep.size();
+    allToAll(rep.data(), sendOff, recvBuf, recvOff);
+  }
+
+private:
+  template<class SF, class RF>
+  void exchange(SF sendPiece, RF recvPiece) {
+    for (int s = 1; s < nranks_; s++) {
+      int to = (rank_ + s) % nranks_;
+      int from = (rank_ - s + nranks_) % nranks_;
+      auto out = sendPiece(to);
+      auto in = recvPiece(from);
+      int toFd = fds_[to];
+      auto sender = std::async(std::launch::async, [toFd, out]() { sendBytes(toFd, out.first, out.second); });
+      recvBytes(fds_[from], in.first, in.second);
+      sender.get();
+    }
+  }
+};
+
+// distributedSort sorts the union of the local vectors on all of the ranks in comm.  On return local
+// holds this rank's sorted part of the global order, which may be larger or smaller than the input shard.
+// samplesPerRank controls the number of samples each rank contributes to the splitter selection.
+// If times is not null, the time spent in each phase is returned there.
+template<class T, class CF>
+void distributedSort(sortComm& comm, std::vector<T>& local, CF compFunc, size_t threads = 0,
+  distributedSortTimes* times = nullptr, size_t samplesPerRank = 0) {
+  static_assert(std::is_trivially_copyable<T>::value, "distributedSort requires a trivially copyable type");
+  typedef std::chrono::high_resolution_clock clock;
+  auto seconds = [](clock::time_point a, clock::time_point b) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(b - a).count() / 1000000.0;
+  };
+  if (threads == 0) threads = std::thread::hardware_concurrency();
+  const int nranks = comm.size();
+
+  // phase 1: sort the local shard.
+  auto t0 = clock::now();
+  parallelSort(local.begin(), local.end(), compFunc, threads);
+  auto t1 = clock::now();
+  if (nranks == 1) {
+    if (times != nullptr) { times->localSort = seconds(t0, t1); }
+    return;
+  }
+
+  // phase 2: pick the global splitters from regularly spaced samples of every rank's sorted shard.
+  if (samplesPerRank == 0) samplesPerRank = 16 * (size_t)nranks;
+  std::vector<T> samples;
+  size_t ns = minimum(samplesPerRank, local.size());
+  // the samples are at the middle of ns equal parts, in integer math so that the last one is before the end even when
+  // the shard has no more elements than samples.
+  for (size_t i = 0; i < ns; i++) samples.push_back(local[i * local.size() / ns + local.size() / (2 * ns)]);
+  std::vector<T> allSamples;
+  std::vector<size_t> sampleOff;
+  comm.allGather(samples, allSamples, sampleOff);
+  std::sort(allSamples.begin(), allSamples.end(), compFunc);
+  std::vector<size_t> sendOff(nranks + 1);
+  sendOff[0] = 0;
+  sendOff[nranks] = local.size();
+  for (int j = 1; j < nranks; j++) {
+    if (allSamples.empty()) {
+      sendOff[j] = local.size();
+      continue;
+    }
+    const T& splitter = allSamples[(size_t)j * allSamples.size() / nranks];
+    sendOff[j] = std::upper_bound(local.begin() + sendOff[j - 1], local.end(), splitter, compFunc) - local.begin();
+  }
+  auto t2 = clock::now();
+
+  // phase 3: send each rank the piece of the local shard that falls between its splitters.
+  std::vector<T> received;
+  std::vector<size_t> recvOff;
+  comm.allToAll(local.data(), sendOff, received, recvOff);
+  auto t3 = clock::now();
+
+  // phase 4: merge the sorted pieces pairwise with parallelMerge until there is one sorted run.
+  std::vector<size_t> runs(recvOff.begin(), recvOff.end());
+  local.resize(received.size());
+  T* src = received.data();
+  T* dst = local.data();
+  while (runs.size() > 2) {
+    std::vector<size_t> next;
+    size_t r;
+    for (r = 0; r + 2 < runs.size(); r += 2) {
+      size_t lb = runs[r], lm = runs[r + 1], le = runs[r + 2];
+      if (lb == lm || lm == le) std::copy(src + lb, src + le, dst + lb);
+      else parallelMerge(dst, src, lb, lm - 1, lm, le - 1, lb, compFunc, minimum(threads, maximum((le - lb) / 128, 1)));
+      next.push_back(lb);
+    }
+    if (r + 1 < runs.size()) {  // an odd run left over is just copied to the next level
+      std::copy(src + runs[r], src + runs[r + 1], dst + runs[r]);
+      next.push_back(runs[r]);
+    }
+    next.push_back(runs.back());
+    runs.swap(next);
+    std::swap(src, dst);
+  }
+  if (src != local.data()) std::copy(src, src + received.size(), local.data());
+  auto t4 = clock::now();
+
+  if (times != nullptr) {
+    times->localSort = seconds(t0, t1);
+    times->splitters = seconds(t1, t2);
+    times->exchange = seconds(t2, t3);
+    times->merge = seconds(t3, t4);
+  }
+}
+
+template<class T>
+void distributedSort(sortComm& comm, std::vector<T>& local, size_t threads = 0, distributedSortTimes* times = nullptr) {
+  distributedSort(comm, local, std::less<T>(), threads, times);
+}
+
+// launchLocalRanks is a test launcher that forks nranks processes on this machine and runs rankMain(rank, nranks)
+// in each one.  The value returned by rankMain is the process exit code.  It must be called before any threads
+// are started by the parent.  It returns the number of ranks that did not exit with 0.
+inline int launchLocalRanks(int nranks, std::function<int(int, int)> rankMain) {
+  std::vector<pid_t> pids;
+  for (int r = 0; r < nranks; r++) {
+    pid_t pid = fork();
+    if (pid < 0) throw std::runtime_error(std::string("launchLocalRanks: fork: ") + strerror(errno));
+    if (pid == 0) {
+      int rc = 1;
+      try {
+        rc = rankMain(r, nranks);
+      }
+      catch (const std::exception& e) {
+        std::cout << "rank " << r << ": " << e.what() << std::endl;
+      }
+      std::cout.flush();
+      _exit(rc);
+    }
+    pids.push_back(pid);
+  }
+  int failures = 0;
+  for (pid_t pid : pids) {
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failures++;
+  }
+  return failures;
+}
+
+#endif // __unix__ || __APPLE__
+
+#endif // DISTRIBUTEDSORT_HPP
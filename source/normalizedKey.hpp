@@ -0,0 +1,179 @@
+/**
+* normalizedKey.hpp
+*
+ * Copyright (c) 2023 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef NORMALIZEDKEY_HPP
+#define NORMALIZEDKEY_HPP
+
+// A composite sort key such as (int32_t tenant, int64_t timestamp descending, uint16_t seq) is usually sorted with a
+// comparator that compares the fields one at a time, with a branch per field and per type.  keyBuilder instead packs
+// the fields, most significant first, into a normalizedKey of 64 bit words whose unsigned integer order is the order
+// of the tuple.  Comparing two keys is then a comparison of one or two integers.
+//   unsigned integers    as they are
+//   signed integers      with the sign bit flipped, so that negative values come first
+//   floats and doubles   as floatKey, the IEEE totalOrder of parallelSort.hpp
+//   fixed width strings  byte by byte, padded with zero bytes, so that a shorter string comes before its extensions
+//   descending fields    with all of their bits flipped
+// A normalizedKey is a struct, which parallelSort sorts by comparing a word at a time in its merges.  The one word of a
+// normalizedKey<1>, key.words[0], is a uint64_t that can be sorted with the integer paths of parallelSort instead.
+// parallelSortByKey sorts records by a key built from each one.
+
+#include <stdint.h>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include "parallelSort.hpp"
+#include "parallelPermute.hpp"
+
+// normalizedKey holds Words 64 bit words compared in order, the first word most significant.
+template<size_t Words>
+struct normalizedKey {
+  uint64_t words[Words];
+
+  bool operator<(const normalizedKey& other) const {
+    for (size_t i = 0; i < Words - 1; i++) {
+      if (words[i] != other.words[i]) return words[i] < other.words[i];
+    }
+    return words[Words - 1] < other.words[Words - 1];
+  }
+  bool operator==(const normalizedKey& other) const {
+    for (size_t i = 0; i < Words; i++) {
+      if (words[i] != other.words[i]) return false;
+    }
+    return true;
+  }
+  bool operator!=(const normalizedKey& other) const { return !(*this == other); }
+};
+
+// keyBuilder appends the fields of a key from the most significant to the least.  The unused low bits of the key are 0.
+template<size_t Words>
+class keyBuilder {
+  normalizedKey<Words> key_;
+  size_t bits_ = 0;
+
+  // append the low width bits of v.
+  void appendBits(uint64_t v, size_t width, bool descending) {
+    if (width < 64) v &= ((uint64_t)1 << width) - 1;
+    if (descending) v = width < 64 ? v ^ (((uint64_t)1 << width) - 1) : ~v;
+    if (bits_ + width > Words * 64) throw std::runtime_error("keyBuilder: the fields do not fit in the key");
+    const size_t word = bits_ / 64, free = 64 - bits_ % 64;
+    if (width <= free) key_.words[word] |= width == 64 ? v : v << (free - width);
+    else {
+      key_.words[word] |= v >> (width - free);
+      // the check above keeps word + 1 in the key; testing it again lets the compiler see that for Words = 1.
+      if (word + 1 < Words) key_.words[word + 1] |= v << (64 - (width - free));
+    }
+    bits_ += width;
+  }
+
+public:
+  keyBuilder() {
+    for (size_t i = 0; i < Words; i++) key_.words[i] = 0;
+  }
+
+  // add an integral field.
+  template<class T>
+  typename std::enable_if<std::is_integral<T>::value, keyBuilder&>::type add(T v, bool descending = false) {
+    const size_t width = sizeof(T) * 8;
+    uint64_t u = (uint64_t)(typename std::make_unsigned<T>::type)v;
+    if (std::is_signed<T>::value) u ^= (uint64_t)1 << (width - 1);
+    appendBits(u, width, descending);
+    return *this;
+  }
+
+  // add a float or double field.
+  template<class T>
+  typename std::enable_if<isSortableFloat<T>::value, keyBuilder&>::type add(T v, bool descending = false) {
+    appendBits((uint64_t)floatKey(v), sizeof(T) * 8, descending);
+    return *this;
+  }
+
+#ifdef __SIZEOF_INT128__
+  // add a 128 bit field, such as an id.
+  keyBuilder& add(unsigned __int128 v, bool descending = false) {
+    appendBits((uint64_t)(v >> 64), 64, descending);
+    appendBits((uint64_t)v, 64, descending);
+    return *this;
+  }
+  keyBuilder& add(__int128 v, bool descending = false) {
+    return add((unsigned __int128)v ^ ((unsigned __int128)1 << 127), descending);
+  }
+#endif
+
+  // add a string field of width bytes.  Bytes after the end of s, or after a zero byte, are 0.
+  keyBuilder& addString(const char* s, size_t len, size_t width, bool descending = false) {
+    bool ended = false;
+    for (size_t i = 0; i < width; i++) {
+      ended = ended || i >= len || s[i] == 0;
+      appendBits(ended ? 0 : (uint8_t)s[i], 8, descending);
+    }
+    return *this;
+  }
+
+  // add len raw bytes compared as unsigned bytes, like memcmp, 8 at a time.
+  keyBuilder& addBytes(const void* p, size_t len, bool descending = false) {
+    const unsigned char* bytes = (const unsigned char*)p;
+    for (size_t i = 0; i < len; i += 8) {
+      const size_t chunk = minimum(len - i, 8);
+      uint64_t v = 0;
+      for (size_t j = 0; j < chunk; j++) v = (v << 8) | bytes[i + j];
+      appendBits(v, chunk * 8, descending);
+    }
+    return *this;
+  }
+
+  normalizedKey<Words> key() const { return key_; }
+};
+
+// keyedIndex is a key with the position of its record, which breaks ties so that sorts by key are stable.
+template<size_t Words>
+struct keyedIndex {
+  normalizedKey<Words> key;
+  size_t index;
+
+  bool operator<(const keyedIndex& other) const {
+    return key < other.key || (key == other.key && index < other.index);
+  }
+};
+
+// parallelSortByKey sorts the records of [begin, end) by keyFn(record), which returns a normalizedKey.  The keys are
+// built in parallel with the position of their record, the keys are sorted with parallelSort, and the records are
+// moved into their sorted order with parallelGather through a copy.  Records with equal keys stay in input order.
+template< class E, class RandomIt, class KeyFn, typename std::enable_if<isExecutor<E>::value, int>::type = 0>
+void parallelSortByKey(E& exec, RandomIt begin, RandomIt end, KeyFn keyFn, size_t threads = 0) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  typedef decltype(keyFn(*begin)) K;
+  typedef keyedIndex<sizeof(K) / sizeof(uint64_t)> KI;
+  if (threads == 0) threads = exec.concurrency();
+  const size_t len = end - begin;
+  if (len < 2) return;
+  std::vector<KI> keys(len);
+  parallelForRange(exec, (size_t)0, len, [&](size_t lb, size_t le) {
+    for (size_t i = lb; i < le; i++) {
+      keys[i].key = keyFn(*(begin + i));
+      keys[i].index = i;
+    }
+    }, 4096, schedStatic, threads);
+  parallelSort(exec, keys.begin(), keys.end(), std::less<KI>(), threads);
+
+  std::vector<size_t> order(len);
+  parallelForRange(exec, (size_t)0, len, [&](size_t lb, size_t le) {
+    for (size_t i = lb; i < le; i++) order[i] = keys[i].index;
+    }, 4096, schedStatic, threads);
+  std::vector<T> sorted(len);
+  parallelGather(exec, begin, order.begin(), len, sorted.begin(), threads);
+  parallelForRange(exec, (size_t)0, len, [&](size_t lb, size_t le) {
+    std::move(sorted.begin() + lb, sorted.begin() + le, begin + lb);
+    }, 4096, schedStatic, threads);
+}
+
+template< class RandomIt, class KeyFn>
+void parallelSortByKey(RandomIt begin, RandomIt end, KeyFn keyFn, size_t threads = 0) {
+  parallelSortByKey(defaultExecutor(), begin, end, keyFn, threads);
+}
+
+#endif // NORMALIZEDKEY_HPP
@@ -9,102 +9,600 @@
 
 
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iterator>
 #include <future>
+#include <thread>
 #include <mutex>
 #include <vector>
 #include <numeric>
+#include <memory>
+#include <type_traits>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "threadPool.hpp"
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 //#define DEBUG
 
+// threadPrioritySetting describes the OS priority of the threads that do the work of a parallel call.
+// A background setting runs them under SCHED_IDLE, or if that is not allowed, at a raised nice value, so
+// they only use cores that latency sensitive work leaves idle.  The setting of the calling thread is
+// passed on to every thread that parallelFor and parallelForNoWait start.  Priorities are only changed on Linux.
+struct threadPrioritySetting {
+  bool background = false;
+  bool idleScheduler = true;  // try SCHED_IDLE first
+  int niceValue = 19;         // used when SCHED_IDLE is not available
+};
+
+inline threadPrioritySetting& currentThreadPriority() {
+  thread_local threadPrioritySetting setting;
+  return setting;
+}
+
+// scopedThreadPriority applies a setting to the current thread.  Lowering a priority usually cannot be undone
+// without privileges, so only use it on threads that end with the scope, as the parallelFor threads do.
+class scopedThreadPriority {
+  threadPrioritySetting saved_;
+
+public:
+  explicit scopedThreadPriority(const threadPrioritySetting& setting) : saved_(currentThreadPriority()) {
+    currentThreadPriority() = setting;
+    if (!setting.background) return;
+#ifdef __linux__
+    bool idle = false;
+#ifdef SCHED_IDLE
+    if (setting.idleScheduler) {
+      sched_param param;
+      param.sched_priority = 0;
+      idle = sched_setscheduler(0, SCHED_IDLE, &param) == 0;  // 0 is the calling thread on Linux
+    }
+#endif
+    if (!idle) setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), setting.niceValue);
+#endif
+  }
+  ~scopedThreadPriority() { currentThreadPriority() = saved_; }
+  scopedThreadPriority(const scopedThreadPriority&) = delete;
+  scopedThreadPriority& operator=(const scopedThreadPriority&) = delete;
+};
+
+// Executors decide where the segments of the parallel primitives run.  parallelFor, parallelForNoWait,
+// parallelMerge and parallelSort all take an optional executor as their first argument.  An executor is any
+// class derived from executorBase that provides
+//   size_t concurrency()                      the number of threads it can run at once
+//   void bulk(int64_t n, F fn)                runs fn(i) for i in [0, n) and returns when all are done.
+//                                             The calling thread may run some of them.
+//   handle bulkSubmit(int64_t n, F fn)        starts fn(i) for i in [0, n) and returns without waiting
+//   handle submit(F fn)                       starts fn() and returns without waiting
+//   void wait(handle& h)                      waits for what a bulkSubmit or submit started
+// The executors provided are asyncExecutor (a std::async thread per segment, the default), poolExecutor
+// (a threadPool the application already owns), openmpExecutor (OpenMP, when compiled with OpenMP) and
+// inlineExecutor (everything runs serially on the calling thread).
+struct executorBase {};
+
+template<class E>
+struct isExecutor : std::is_base_of<executorBase, typename std::decay<E>::type> {};
+
+// asyncExecutor starts a new thread with std::async for each segment, passing on the calling thread's priority.
+class asyncExecutor : public executorBase {
+public:
+  typedef std::vector<std::future<void>> handle;
+
+  size_t concurrency() const { return std::thread::hardware_concurrency(); }
+
+  template<class F>
+  handle bulkSubmit(int64_t n, F fn) {
+    handle futures;
+    threadPrioritySetting priority = currentThreadPriority();
+    for (int64_t i = 0; i < n; i++) {
+      futures.push_back(std::async(std::launch::async, [fn, priority](int64_t i) {
+        scopedThreadPriority threadPriority(priority);
+        fn(i);
+        }, i));
+    }
+    return futures;
+  }
+
+  template<class F>
+  handle submit(F fn) { return bulkSubmit(1, [fn](int64_t) { fn(); }); }
+
+  void wait(handle& futures) {
+    for (size_t i = 0; i < futures.size(); i++) futures[i].wait();
+    futures.clear();
+  }
+
+  // start threads for all but the last one, which is run on the calling thread.
+  template<class F>
+  void bulk(int64_t n, F fn) {
+    if (n <= 0) return;
+    handle futures = bulkSubmit(n - 1, [&fn](int64_t i) { fn(i); });
+    fn(n - 1);
+    wait(futures);
+  }
+};
+
+// inlineExecutor runs everything serially on the calling thread.  It is useful for debugging and as a baseline.
+class inlineExecutor : public executorBase {
+public:
+  struct handle {};
+
+  size_t concurrency() const { return 1; }
+
+  template<class F>
+  handle bulkSubmit(int64_t n, F fn) {
+    for (int64_t i = 0; i < n; i++) fn(i);
+    return handle();
+  }
+
+  template<class F>
+  handle submit(F fn) {
+    fn();
+    return handle();
+  }
+
+  void wait(handle&) {}
+
+  template<class F>
+  void bulk(int64_t n, F fn) { bulkSubmit(n, fn); }
+};
+
+// poolExecutor runs the segments as tasks on a threadPool.  A thread waiting for tasks runs queued pool tasks
+// while it waits, so nested parallel calls made from pool tasks cannot deadlock the pool.
+class poolExecutor : public executorBase {
+  threadPool& pool_;
+
+public:
+  typedef std::shared_ptr<taskGroup> handle;
+
+  explicit poolExecutor(threadPool& pool = globalThreadPool()) : pool_(pool) {}
+
+  size_t concurrency() const { return pool_.size(); }
+
+  template<class F>
+  handle bulkSubmit(int64_t n, F fn) {
+    handle group = std::make_shared<taskGroup>();
+    auto shared = std::make_shared<F>(fn);
+    for (int64_t i = 0; i < n; i++) pool_.submit(*group, [shared, i]() { (*shared)(i); });
+    return group;
+  }
+
+  template<class F>
+  handle submit(F fn) { return bulkSubmit(1, [fn](int64_t) { fn(); }); }
+
+  void wait(handle& group) {
+    if (group != nullptr) pool_.wait(*group);
+  }
+
+  // submit all but the last one, which is run on the calling thread.
+  template<class F>
+  void bulk(int64_t n, F fn) {
+    if (n <= 0) return;
+    handle group = bulkSubmit(n - 1, [&fn](int64_t i) { fn(i); });
+    fn(n - 1);
+    wait(group);
+  }
+};
+
+#ifdef _OPENMP
+// openmpExecutor runs a bulk call as an OpenMP parallel region with one thread per segment.  OpenMP has no way to
+// return from a parallel region before it is done, so bulkSubmit and submit run to completion before returning.
+class openmpExecutor : public executorBase {
+public:
+  struct handle {};
+
+  size_t concurrency() const { return (size_t)omp_get_max_threads(); }
+
+  template<class F>
+  void bulk(int64_t n, F fn) {
+    if (n <= 0) return;
+#pragma omp parallel for num_threads((int)n) schedule(static, 1)
+    for (int64_t i = 0; i < n; i++) fn(i);
+  }
+
+  template<class F>
+  handle bulkSubmit(int64_t n, F fn) {
+    bulk(n, fn);
+    return handle();
+  }
+
+  template<class F>
+  handle submit(F fn) {
+    fn();
+    return handle();
+  }
+
+  void wait(handle&) {}
+};
+#endif // _OPENMP
+
+// the executor used by the functions that are not given one.
+inline asyncExecutor& defaultExecutor() {
+  static asyncExecutor executor;
+  return executor;
+}
+
 // parallel_for runs the equivalent to the statement "for (int i = begin; i < end; i++) fn(i);"
 // where fn is a lambda.  if num_segs is greater than 1, it divides the the begin-end number range 
-// into that many  segments and start starts separate threads to execute the first num_segs-1 segments
-// The last segment is run on the current thread.  
+// into that many  segments and runs them on the executor.  The default executor starts separate
+// threads to execute the first num_segs-1 segments and the last segment is run on the current thread.  
 // parallel_for returns after all treads segments have completed.
-template< class RandomIt, class FN >
-void parallelFor(const RandomIt begin, const RandomIt end, FN fn, int64_t num_segs = 1) {
+template< class E, class RandomIt, class FN, typename std::enable_if<isExecutor<E>::value, int>::type = 0 >
+void parallelFor(E& exec, const RandomIt begin, const RandomIt end, FN fn, int64_t num_segs = 1) {
 
   // compute the number iterations and if 0, then return
   const int64_t n = end - begin;
   if (n == 0) return;
   // if the number of elements is less than the number of segments or threads, reduce the number of segments
   if (n < num_segs) num_segs = n;
-  // create the array of futures.
-  std::vector<std::future<void>> futures;
+  if (num_segs < 1) num_segs = 1;
   // Compute the number of iterations to preform on each segment using a double to preserve the fraction.
   // using the method of iterating through bounds applied to each thread using a double and then rounding to
   // the nearest integer ensures that the difference in the number of iterations that each thread will do is 
   // no greater than one.
   double seg_size = (double)n / (double)num_segs;
-  int64_t sBeg = 0;
-  double sEnd = seg_size;
-  // start threads for one less than the number of segments
-  for (int64_t seg = 0; seg < num_segs-1; seg++) { 
-    futures.push_back(std::async(std::launch::async, [begin, fn](int64_t lb, int64_t le) {
+  exec.bulk(num_segs, [begin, &fn, seg_size, n, num_segs](int64_t seg) {
+    int64_t lb = llround(seg * seg_size);
+    int64_t le = seg == num_segs - 1 ? n : llround((seg + 1) * seg_size);
 #ifdef DEBUG
-      {
-        static std::mutex lock;
-        std::lock_guard<std::mutex> guard(lock);
-        std::cout << "parallel_for: n == " << le - lb << " thread: " << std::this_thread::get_id() << '\n';
-      }
+    {
+      static std::mutex lock;
+      std::lock_guard<std::mutex> guard(lock);
+      std::cout << "parallel_for: n == " << le - lb << " thread: " << std::this_thread::get_id() << '\n';
+    }
 #endif // DEBUG
-      for (int64_t i = lb; i < le; i++) fn(begin + i);
-      }, sBeg, llround(sEnd)));
-    sBeg = llround(sEnd);
-    sEnd += seg_size;
-  }
-  // execute the last segment in this thread
-  for (int64_t i = sBeg; i < llround(sEnd); i++) fn(begin + i);
+    for (int64_t i = lb; i < le; i++) fn(begin + i);
+    });
+}
 
-  // wait for the segments to complete
-  for (int seg = 0; seg < futures.size(); seg++)
-    futures[seg].wait();
+template< class RandomIt, class FN >
+void parallelFor(const RandomIt begin, const RandomIt end, FN fn, int64_t num_segs = 1) {
+  parallelFor(defaultExecutor(), begin, end, fn, num_segs);
 }
 
 // parallelFor runs the equivalent to the statement "for (int i = begin; i < end; i++) fn(i);"
 // where fn is a lambda.  if num_segs is greater than 1, it divides the the begin-end number range 
-// into that many  segments and start starts separate threads to execute the first num_segs-1 segments
-// The last segment is run on the current thread.  
+// into that many  segments and starts all of them on the executor.
 // parallelForBoWait returns before checking that all thread are done.  parallelForFinish() must be
-// called make sure all of the threads have finished.  
-template< class RandomIt, class FN >
-std::vector<std::future<void>>*  parallelForNoWait(const RandomIt begin, const RandomIt end, FN fn, int64_t num_segs = 1) {
-  
-  auto* futuresNW = new std::vector<std::future<void>>;
+// called with the handle it returns to make sure all of the segments have finished.  
+template< class E, class RandomIt, class FN, typename std::enable_if<isExecutor<E>::value, int>::type = 0 >
+typename E::handle parallelForNoWait(E& exec, const RandomIt begin, const RandomIt end, FN fn, int64_t num_segs = 1) {
 
   // compute the number iterations and if 0, then return
   const int64_t n = end - begin;
-  if (n == 0) return futuresNW;
+  if (n == 0) return typename E::handle();
   // if the number of elements is less than the number of segments or threads, reduce the number of segments
   if (n < num_segs) num_segs = n;
+  if (num_segs < 1) num_segs = 1;
   // Compute the number of iterations to preform on each segment using a double to preserve the fraction.
-  // using the method of iterating through bounds applied to each thread using a double and then rounding to
-  // the nearest integer ensures that the difference in the number of iterations that each thread will do is 
-  // no greater than one.
   double seg_size = (double)n / (double)num_segs;
-  int64_t sBeg = 0;
-  double sEnd = seg_size;
-  // start threads for one less than the number of segments
-  static std::mutex lock;
-  for (int64_t seg = 0; seg < num_segs; seg++) {
-    futuresNW->push_back(std::async(std::launch::async, [begin, fn](int64_t lb, int64_t le) {
-      for (int64_t i = lb; i < le; i++) fn(begin + i);
-      }, sBeg, llround(sEnd)));
-    sBeg = llround(sEnd);
-    sEnd += seg_size;
-  }
+  return exec.bulkSubmit(num_segs, [begin, fn, seg_size, n, num_segs](int64_t seg) {
+    int64_t lb = llround(seg * seg_size);
+    int64_t le = seg == num_segs - 1 ? n : llround((seg + 1) * seg_size);
+    for (int64_t i = lb; i < le; i++) fn(begin + i);
+    });
+}
 
-  return futuresNW;
-  }
+template< class E, typename std::enable_if<isExecutor<E>::value, int>::type = 0 >
+void parallelForFinish(E& exec, typename E::handle& handle) {
+  exec.wait(handle);
+}
 
-void parallelForFinish(std::vector<std::future<void>>* futuresNW) {
+// the original interface on the default executor.  The returned pointer must be passed to parallelForFinish().
+template< class RandomIt, class FN >
+std::vector<std::future<void>>*  parallelForNoWait(const RandomIt begin, const RandomIt end, FN fn, int64_t num_segs = 1) {
+  return new std::vector<std::future<void>>(parallelForNoWait(defaultExecutor(), begin, end, fn, num_segs));
+}
+
+inline void parallelForFinish(std::vector<std::future<void>>* futuresNW) {
   if (futuresNW == nullptr) return;
   // wait for the segments to complete
-  for (size_t seg = 0; seg < futuresNW->size(); seg++)
-    futuresNW->at(seg).wait();
+  defaultExecutor().wait(*futuresNW);
   delete futuresNW;
 }
 
+// the ways parallelForRange hands out chunks of the range to its workers.
+//   schedStatic    each worker gets one contiguous chunk of about (end - begin) / workers iterations.
+//   schedDynamic   the workers take chunks of grain iterations from a shared atomic counter until the range
+//                  is used up, which balances iterations of uneven cost.
+//   schedGuided    like schedDynamic, but each chunk is the remaining iterations / workers, and never less
+//                  than grain, so there are few large chunks at the start and small ones to balance the end.
+enum loopSchedule { schedStatic, schedDynamic, schedGuided };
+
+// parallelForRange runs the equivalent to the statement "fn(begin, end)" split into chunks that run on the
+// executor, so that fn is called once per chunk as fn(lb, le) rather than once per index and the loop inside fn
+// can be vectorized.  threads is the number of workers, the concurrency of the executor when 0, and is reduced so
+// that each worker has at least grain iterations.  The calling thread is one of the workers.  With schedStatic the
+// chunk bounds are the same as the segments of parallelFor with num_segs = threads.
+template< class E, class RandomIt, class FN, typename std::enable_if<isExecutor<E>::value, int>::type = 0 >
+void parallelForRange(E& exec, const RandomIt begin, const RandomIt end, FN fn, int64_t grain = 1,
+  loopSchedule schedule = schedStatic, int64_t threads = 0) {
+
+  const int64_t n = end - begin;
+  if (n <= 0) return;
+  if (grain < 1) grain = 1;
+  if (threads <= 0) threads = (int64_t)exec.concurrency();
+  int64_t workers = std::min(threads, (n + grain - 1) / grain);
+  if (workers < 1) workers = 1;
+  if (workers == 1) {
+    fn(begin, end);
+    return;
+  }
+
+  if (schedule == schedStatic) {
+    double seg_size = (double)n / (double)workers;
+    exec.bulk(workers, [begin, &fn, seg_size, n, workers](int64_t w) {
+      int64_t lb = llround(w * seg_size);
+      int64_t le = w == workers - 1 ? n : llround((w + 1) * seg_size);
+      fn(begin + lb, begin + le);
+      });
+    return;
+  }
+
+  std::atomic<int64_t> next{ 0 };
+  exec.bulk(workers, [begin, &fn, &next, n, grain, workers, schedule](int64_t) {
+    while (true) {
+      int64_t lb, le;
+      if (schedule == schedDynamic) {
+        lb = next.fetch_add(grain);
+        if (lb >= n) return;
+        le = std::min(lb + grain, n);
+      }
+      else {
+        lb = next.load();
+        do {
+          if (lb >= n) return;
+          le = lb + std::max(grain, (n - lb) / workers);
+          if (le > n) le = n;
+        } while (!next.compare_exchange_weak(lb, le));
+      }
+      fn(begin + lb, begin + le);
+    }
+    });
+}
+
+template< class RandomIt, class FN >
+void parallelForRange(const RandomIt begin, const RandomIt end, FN fn, int64_t grain = 1,
+  loopSchedule schedule = schedStatic, int64_t threads = 0) {
+  parallelForRange(defaultExecutor(), begin, end, fn, grain, schedule, threads);
+}
+
+// The reductions and scans below split the range into blocks of at least grain elements, one per worker,
+// the same way as parallelForRange with schedStatic.  threads = 0 means the concurrency of the executor.
+// The operations must be associative, and the blocks are combined in order, so they need not be commutative.
+// With one block they are the serial std:: algorithm.
+
+// paddedValue holds one per-block result on a cache line of its own.  Blocks on different threads then never write to
+// the same line, and a bool result is a real bool rather than a bit of a std::vector<bool>.
+template<class T>
+struct alignas(64) paddedValue {
+  T value;
+};
+
+// parallelTransformReduce returns init combined with transform(*it) for each element of [begin, end) using reduce,
+// like std::transform_reduce.  Each block is reduced on its own thread and the block results are combined in order.
+template< class E, class RandomIt, class T, class ReduceOp, class TransformOp, typename std::enable_if<isExecutor<E>::value, int>::type = 0 >
+T parallelTransformReduce(E& exec, RandomIt begin, RandomIt end, T init, ReduceOp reduce, TransformOp transform,
+  int64_t grain = 4096, int64_t threads = 0) {
+
+  const int64_t n = end - begin;
+  if (n <= 0) return init;
+  if (grain < 1) grain = 1;
+  if (threads <= 0) threads = (int64_t)exec.concurrency();
+  const int64_t blocks = std::max<int64_t>(std::min(threads, n / grain), 1);
+  if (blocks == 1) {
+    for (RandomIt it = begin; it != end; ++it) init = reduce(init, transform(*it));
+    return init;
+  }
+
+  // each block starts from its first element so that no identity value is needed.
+  std::vector<paddedValue<T>> partial(blocks, paddedValue<T>{ init });
+  double seg_size = (double)n / (double)blocks;
+  exec.bulk(blocks, [&](int64_t b) {
+    int64_t lb = llround(b * seg_size);
+    int64_t le = b == blocks - 1 ? n : llround((b + 1) * seg_size);
+    T acc = transform(*(begin + lb));
+    for (int64_t i = lb + 1; i < le; i++) acc = reduce(acc, transform(*(begin + i)));
+    partial[b].value = acc;
+    });
+  for (int64_t b = 0; b < blocks; b++) init = reduce(init, partial[b].value);
+  return init;
+}
+
+template< class RandomIt, class T, class ReduceOp, class TransformOp >
+T parallelTransformReduce(RandomIt begin, RandomIt end, T init, ReduceOp reduce, TransformOp transform,
+  int64_t grain = 4096, int64_t threads = 0) {
+  return parallelTransformReduce(defaultExecutor(), begin, end, init, reduce, transform, grain, threads);
+}
+
+// parallelReduce returns init combined with every element of [begin, end) using reduce, like std::reduce.
+template< class E, class RandomIt, class T, class ReduceOp = std::plus<T>, typename std::enable_if<isExecutor<E>::value, int>::type = 0 >
+T parallelReduce(E& exec, RandomIt begin, RandomIt end, T init, ReduceOp reduce = ReduceOp(), int64_t grain = 4096, int64_t threads = 0) {
+  typedef typename std::iterator_traits<RandomIt>::value_type V;
+  return parallelTransformReduce(exec, begin, end, init, reduce, [](const V& v) -> const V& { return v; }, grain, threads);
+}
+
+template< class RandomIt, class T, class ReduceOp = std::plus<T> >
+T parallelReduce(RandomIt begin, RandomIt end, T init, ReduceOp reduce = ReduceOp(), int64_t grain = 4096, int64_t threads = 0) {
+  return parallelReduce(defaultExecutor(), begin, end, init, reduce, grain, threads);
+}
+
+// parallelScan writes the prefix combinations of [begin, end) to [dest, dest + (end - begin)) with the two-pass
+// blocked algorithm.  The first pass reduces each block, the block totals are scanned serially to give the offset
+// of each block, and the second pass scans each block starting from its offset.  When inclusive is true element i
+// of the output includes element i of the input, like std::inclusive_scan, otherwise it does not and the first
+// output is init, like std::exclusive_scan.  dest may be begin to scan in place.  It returns the end of the output.
+template< class E, class RandomIt, class OutIt, class T, class ScanOp, typename std::enable_if<isExecutor<E>::value, int>::type = 0 >
+OutIt parallelScan(E& exec, RandomIt begin, RandomIt end, OutIt dest, T init, ScanOp op, bool inclusive,
+  int64_t grain = 4096, int64_t threads = 0) {
+
+  const int64_t n = end - begin;
+  if (n <= 0) return dest;
+  if (grain < 1) grain = 1;
+  if (threads <= 0) threads = (int64_t)exec.concurrency();
+  const int64_t blocks = std::max<int64_t>(std::min(threads, n / grain), 1);
+  double seg_size = (double)n / (double)blocks;
+  auto scanBlock = [&](int64_t lb, int64_t le, T acc) {
+    for (int64_t i = lb; i < le; i++) {
+      T v = *(begin + i);
+      if (inclusive) {
+        acc = op(acc, v);
+        *(dest + i) = acc;
+      }
+      else {
+        *(dest + i) = acc;
+        acc = op(acc, v);
+      }
+    }
+  };
+  if (blocks == 1) {
+    scanBlock(0, n, init);
+    return dest + n;
+  }
+
+  // first pass: the total of each block but the last.
+  std::vector<paddedValue<T>> offset(blocks, paddedValue<T>{ init });
+  exec.bulk(blocks - 1, [&](int64_t b) {
+    int64_t lb = llround(b * seg_size);
+    int64_t le = llround((b + 1) * seg_size);
+    T acc = *(begin + lb);
+    for (int64_t i = lb + 1; i < le; i++) acc = op(acc, *(begin + i));
+    offset[b + 1].value = acc;
+    });
+  // the offset of each block is init combined with the totals of the blocks before it.
+  for (int64_t b = 1; b < blocks; b++) offset[b].value = op(offset[b - 1].value, offset[b].value);
+
+  // second pass: scan each block from its offset.
+  exec.bulk(blocks, [&](int64_t b) {
+    int64_t lb = llround(b * seg_size);
+    int64_t le = b == blocks - 1 ? n : llround((b + 1) * seg_size);
+    scanBlock(lb, le, offset[b].value);
+    });
+  return dest + n;
+}
+
+template< class RandomIt, class OutIt, class T, class ScanOp >
+OutIt parallelScan(RandomIt begin, RandomIt end, OutIt dest, T init, ScanOp op, bool inclusive,
+  int64_t grain = 4096, int64_t threads = 0) {
+  return parallelScan(defaultExecutor(), begin, end, dest, init, op, inclusive, grain, threads);
+}
+
+// parallelInclusiveScan is std::inclusive_scan(begin, end, dest, op) run with parallelScan.
+template< class E, class RandomIt, class OutIt, class ScanOp = std::plus<typename std::iterator_traits<RandomIt>::value_type>,
+  typename std::enable_if<isExecutor<E>::value, int>::type = 0 >
+OutIt parallelInclusiveScan(E& exec, RandomIt begin, RandomIt end, OutIt dest, ScanOp op = ScanOp(), int64_t grain = 4096, int64_t threads = 0) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  if (begin == end) return dest;
+  // the first element starts the scan, so no identity value is needed.
+  T first = *begin;
+  *dest = first;
+  return parallelScan(exec, begin + 1, end, dest + 1, first, op, true, grain, threads);
+}
+
+template< class RandomIt, class OutIt, class ScanOp = std::plus<typename std::iterator_traits<RandomIt>::value_type> >
+OutIt parallelInclusiveScan(RandomIt begin, RandomIt end, OutIt dest, ScanOp op = ScanOp(), int64_t grain = 4096, int64_t threads = 0) {
+  return parallelInclusiveScan(defaultExecutor(), begin, end, dest, op, grain, threads);
+}
+
+// parallelExclusiveScan is std::exclusive_scan(begin, end, dest, init, op) run with parallelScan.
+template< class E, class RandomIt, class OutIt, class T, class ScanOp = std::plus<T>, typename std::enable_if<isExecutor<E>::value, int>::type = 0 >
+OutIt parallelExclusiveScan(E& exec, RandomIt begin, RandomIt end, OutIt dest, T init, ScanOp op = ScanOp(), int64_t grain = 4096, int64_t threads = 0) {
+  return parallelScan(exec, begin, end, dest, init, op, false, grain, threads);
+}
+
+template< class RandomIt, class OutIt, class T, class ScanOp = std::plus<T> >
+OutIt parallelExclusiveScan(RandomIt begin, RandomIt end, OutIt dest, T init, ScanOp op = ScanOp(), int64_t grain = 4096, int64_t threads = 0) {
+  return parallelExclusiveScan(defaultExecutor(), begin, end, dest, init, op, grain, threads);
+}
+
+// concurrencyGovernor is a process-wide budget of worker threads shared by all of the parallel calls
+// that ask for the default number of threads.  Each call acquires a share of the budget and releases it
+// when it finishes.  A call is given at most its fair share, budget / active calls, of the threads that
+// are currently free, and never less than 1, meaning the call runs serially on the caller's own thread.
+// So when many threads sort at once, each one degrades to fewer threads instead of oversubscribing the machine.
+class concurrencyGovernor {
+  std::mutex lock_;
+  int64_t budget_;
+  int64_t available_;
+  int64_t active_ = 0;
+  bool enabled_ = true;
+
+public:
+  explicit concurrencyGovernor(int64_t budget = 0) {
+    if (budget <= 0) budget = std::thread::hardware_concurrency();
+    if (budget <= 0) budget = 1;
+    budget_ = available_ = budget;
+  }
+
+  // set the total number of threads that governed calls may use together.
+  void setBudget(int64_t budget) {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (budget <= 0) budget = 1;
+    available_ += budget - budget_;
+    budget_ = budget;
+  }
+
+  // when disabled every call is granted the threads it asks for.
+  void setEnabled(bool enabled) {
+    std::lock_guard<std::mutex> guard(lock_);
+    enabled_ = enabled;
+  }
+
+  int64_t budget() {
+    std::lock_guard<std::mutex> guard(lock_);
+    return budget_;
+  }
+
+  // acquire up to want threads.  The number taken from the budget, 0 when the governor is disabled,
+  // must be given back with release().
+  int64_t acquire(int64_t want, int64_t& taken) {
+    std::lock_guard<std::mutex> guard(lock_);
+    active_++;
+    taken = 0;
+    if (!enabled_) return want;
+    int64_t share = std::max<int64_t>(budget_ / active_, 1);
+    taken = std::min(std::min(want, share), std::max<int64_t>(available_, 1));
+    available_ -= taken;
+    return taken;
+  }
+
+  void release(int64_t taken) {
+    std::lock_guard<std::mutex> guard(lock_);
+    active_--;
+    available_ += taken;
+  }
+};
+
+// the governor used by parallelSort when it is called with threads = 0.
+inline concurrencyGovernor& globalConcurrencyGovernor() {
+  static concurrencyGovernor governor;
+  return governor;
+}
+
+// governedThreads holds a grant from a concurrencyGovernor for the life of a parallel call.
+class governedThreads {
+  concurrencyGovernor& governor_;
+  int64_t taken_;
+  int64_t granted_;
+
+public:
+  governedThreads(int64_t want, concurrencyGovernor& governor = globalConcurrencyGovernor())
+    : governor_(governor), granted_(governor.acquire(want, taken_)) {}
+  ~governedThreads() { governor_.release(taken_); }
+  governedThreads(const governedThreads&) = delete;
+  governedThreads& operator=(const governedThreads&) = delete;
+
+  int64_t threads() const { return granted_; }
+};
+
 #include <cmath>
 void testParallelFor(size_t threads) {
   auto values = std::vector<double>(1000);
@@ -0,0 +1,169 @@
+/**
+* parallelPartition.hpp
+*
+ * Copyright (c) 2023 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef PARALLELPARTITION_HPP
+#define PARALLELPARTITION_HPP
+
+// parallelPartitionBySplitters groups the elements of a range into key-range buckets without sorting them.
+// Bucket b holds the elements x with splitters[b - 1] <= x < splitters[b], so there is one more bucket than
+// there are splitters.  It is for stages such as a shuffle that only need each record sent to the worker that
+// owns its key range.  The steps are
+//   1. each thread classifies its part of the input with a branchless search of a splitter tree, keeping the
+//      bucket of every element, and counts its elements in each bucket.
+//   2. a parallel exclusive scan of the counts, in bucket-major order, gives each thread its write position in
+//      each bucket.
+//   3. each thread scatters its elements to their buckets in input order through small per-bucket buffers that
+//      are copied to the output a block at a time.
+// Since every thread writes its elements in order and the threads are in input order within each bucket, the
+// partition is stable.  Each element is compared with log2(buckets) splitters once, instead of the log2(n)
+// comparisons of a sort.
+
+#include <stdint.h>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <vector>
+#include "parallelFor.hpp"
+
+// splitterTree holds the splitters in breadth-first order so that finding the bucket of an element is a loop with
+// no data-dependent branches.  The splitters are padded with copies of the last one to a full tree of 2^levels - 1.
+template<class T, class CF>
+class splitterTree {
+  std::vector<T> tree_;  // tree_[1] is the root, and the children of tree_[i] are tree_[2i] and tree_[2i + 1]
+  size_t levels_ = 0;
+  size_t buckets_;
+  CF compFunc_;
+
+  void build(const std::vector<T>& sorted, size_t node, size_t lo, size_t hi) {
+    if (node >= tree_.size()) return;
+    size_t mid = (lo + hi) / 2;
+    tree_[node] = sorted[mid];
+    build(sorted, 2 * node, lo, mid);
+    build(sorted, 2 * node + 1, mid + 1, hi);
+  }
+
+public:
+  splitterTree(const std::vector<T>& splitters, CF compFunc) : buckets_(splitters.size() + 1), compFunc_(compFunc) {
+    if (splitters.empty()) return;
+    while (((size_t)1 << levels_) < buckets_) levels_++;
+    std::vector<T> padded(splitters);
+    padded.resize(((size_t)1 << levels_) - 1, splitters.back());
+    tree_.resize((size_t)1 << levels_);
+    build(padded, 1, 0, padded.size());
+  }
+
+  size_t buckets() const { return buckets_; }
+
+  // the bucket of v is the number of splitters that are not greater than v.
+  size_t bucket(const T& v) const {
+    size_t i = 1;
+    for (size_t l = 0; l < levels_; l++) i = 2 * i + (compFunc_(v, tree_[i]) ? 0 : 1);
+    i -= (size_t)1 << levels_;
+    return i < buckets_ ? i : buckets_ - 1;
+  }
+};
+
+// chooseSplitters picks buckets - 1 splitters that cut [begin, end) into buckets of about equal size.
+// It sorts a regular sample of oversample elements per bucket and takes every oversample-th one.
+template< class RandomIt, class CF>
+std::vector<typename std::iterator_traits<RandomIt>::value_type> chooseSplitters(RandomIt begin, RandomIt end, size_t buckets,
+  CF compFunc, size_t oversample = 16) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  const size_t len = end - begin;
+  std::vector<T> splitters;
+  if (buckets < 2 || len == 0) return splitters;
+  const size_t samples = std::min(len, buckets * oversample);
+  std::vector<T> sample(samples);
+  for (size_t i = 0; i < samples; i++) sample[i] = *(begin + (size_t)((double(i) + 0.5) * double(len) / double(samples)));
+  std::sort(sample.begin(), sample.end(), compFunc);
+  for (size_t b = 1; b < buckets; b++) splitters.push_back(sample[b * samples / buckets]);
+  return splitters;
+}
+
+// parallelPartitionBySplitters writes the elements of [begin, end) to [out, out + (end - begin)) grouped by bucket, with
+// the elements of each bucket in input order.  splitters must be sorted by compFunc.  bucketOffsets is resized to
+// splitters.size() + 2 and bucket b is [out + bucketOffsets[b], out + bucketOffsets[b + 1]).
+// threads = 0 means the concurrency of the executor.  out must not overlap the input.
+template< class E, class RandomIt, class OutIt, class CF, typename std::enable_if<isExecutor<E>::value, int>::type = 0>
+void parallelPartitionBySplitters(E& exec, RandomIt begin, RandomIt end,
+  const std::vector<typename std::iterator_traits<RandomIt>::value_type>& splitters,
+  OutIt out, std::vector<size_t>& bucketOffsets, CF compFunc, size_t threads = 0) {
+
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  if (threads == 0) threads = exec.concurrency();
+  const size_t len = end - begin;
+  const splitterTree<T, CF> tree(splitters, compFunc);
+  const size_t buckets = tree.buckets();
+  bucketOffsets.assign(buckets + 1, 0);
+  if (len == 0) return;
+
+  // at least 4096 elements per thread, so that the histograms are small next to the data.
+  threads = std::max<size_t>(std::min(threads, len / 4096), 1);
+  const double delta = double(len) / double(threads);
+  auto bound = [len, delta, threads](size_t t) { return t >= threads ? len : (size_t)llround(double(t) * delta); };
+
+  // 1. classify and count.  counts is bucket-major so that the scan below gives the write positions directly.
+  std::vector<uint32_t> bucketOf(len);
+  std::vector<size_t> counts(buckets * threads, 0);
+  parallelFor(exec, (int64_t)0, (int64_t)threads, [&](int64_t t) {
+    std::vector<size_t> local(buckets, 0);
+    for (size_t i = bound(t); i < bound(t + 1); i++) {
+      size_t b = tree.bucket(*(begin + i));
+      bucketOf[i] = (uint32_t)b;
+      local[b]++;
+    }
+    for (size_t b = 0; b < buckets; b++) counts[b * threads + t] = local[b];
+    }, threads);
+
+  // 2. write positions.
+  std::vector<size_t> positions(buckets * threads);
+  parallelExclusiveScan(exec, counts.begin(), counts.end(), positions.begin(), (size_t)0, std::plus<size_t>(), 4096, threads);
+  for (size_t b = 0; b < buckets; b++) bucketOffsets[b] = positions[b * threads];
+  bucketOffsets[buckets] = len;
+
+  // 3. scatter through the write-combining buffers, about 256 bytes per bucket.
+  const size_t bufElems = std::max<size_t>(256 / sizeof(T), 1);
+  parallelFor(exec, (int64_t)0, (int64_t)threads, [&](int64_t t) {
+    std::vector<size_t> pos(buckets);
+    for (size_t b = 0; b < buckets; b++) pos[b] = positions[b * threads + t];
+    if (buckets == 1 || bufElems == 1) {
+      for (size_t i = bound(t); i < bound(t + 1); i++) *(out + pos[bucketOf[i]]++) = *(begin + i);
+      return;
+    }
+    std::vector<T> buf(buckets * bufElems);
+    std::vector<size_t> fill(buckets, 0);
+    for (size_t i = bound(t); i < bound(t + 1); i++) {
+      size_t b = bucketOf[i];
+      buf[b * bufElems + fill[b]] = *(begin + i);
+      if (++fill[b] == bufElems) {
+        std::copy(buf.begin() + b * bufElems, buf.begin() + (b + 1) * bufElems, out + pos[b]);
+        pos[b] += bufElems;
+        fill[b] = 0;
+      }
+    }
+    for (size_t b = 0; b < buckets; b++) {
+      std::copy(buf.begin() + b * bufElems, buf.begin() + b * bufElems + fill[b], out + pos[b]);
+    }
+    }, threads);
+}
+
+template< class RandomIt, class OutIt, class CF>
+void parallelPartitionBySplitters(RandomIt begin, RandomIt end,
+  const std::vector<typename std::iterator_traits<RandomIt>::value_type>& splitters,
+  OutIt out, std::vector<size_t>& bucketOffsets, CF compFunc, size_t threads = 0) {
+  parallelPartitionBySplitters(defaultExecutor(), begin, end, splitters, out, bucketOffsets, compFunc, threads);
+}
+
+// partition into buckets of about equal size with splitters from chooseSplitters.
+template< class RandomIt, class OutIt, class CF>
+void parallelPartitionBySplitters(RandomIt begin, RandomIt end, size_t buckets,
+  OutIt out, std::vector<size_t>& bucketOffsets, CF compFunc, size_t threads = 0) {
+  parallelPartitionBySplitters(begin, end, chooseSplitters(begin, end, buckets, compFunc), out, bucketOffsets, compFunc, threads);
+}
+
+#endif // PARALLELPARTITION_HPP
@@ -0,0 +1,166 @@
+/**
+* parallelPermute.hpp
+*
+ * Copyright (c) 2023 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef PARALLELPERMUTE_HPP
+#define PARALLELPERMUTE_HPP
+
+// Applying a permutation is the last step of an argsort or sort-by-key: the indices from parallelSortIndices are
+// used to reorder one or more arrays of records.  A plain loop misses the cache on nearly every element, since
+// either the reads or the writes jump around the whole array.
+//   parallelGather(src, perm, n, dst)     dst[i] = src[perm[i]]   the writes are in order and the reads are
+//                                                                prefetched a few iterations ahead.
+//   parallelScatter(src, perm, n, dst)    dst[perm[i]] = src[i]   the writes are grouped by destination block
+//                                                                first, so that each block is written while
+//                                                                it is in the cache.
+//   parallelPermuteInPlace(data, perm, n) data[i] = data[perm[i]] without a second array, following the
+//                                                                cycles of the permutation.
+// They are templates on the record type, so records of any width are copied whole.
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <utility>
+#include <vector>
+#include "parallelFor.hpp"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define permutePrefetchRead(p) __builtin_prefetch((p), 0)
+#define permutePrefetchWrite(p) __builtin_prefetch((p), 1)
+#else
+#define permutePrefetchRead(p) ((void)0)
+#define permutePrefetchWrite(p) ((void)0)
+#endif
+
+// the number of iterations ahead that the gather and scatter loops prefetch.
+const size_t permutePrefetchDistance = 16;
+
+// parallelGather sets dst[i] = src[perm[i]] for i in [0, n).  dst must not overlap src.
+template< class E, class SrcIt, class PermIt, class DstIt, typename std::enable_if<isExecutor<E>::value, int>::type = 0>
+void parallelGather(E& exec, SrcIt src, PermIt perm, size_t n, DstIt dst, size_t threads = 0) {
+  parallelForRange(exec, (size_t)0, n, [&](size_t lb, size_t le) {
+    size_t i = lb;
+    for (; i + permutePrefetchDistance < le; i++) {
+      permutePrefetchRead(&*(src + *(perm + i + permutePrefetchDistance)));
+      *(dst + i) = *(src + *(perm + i));
+    }
+    for (; i < le; i++) *(dst + i) = *(src + *(perm + i));
+    }, 4096, schedStatic, (int64_t)threads);
+}
+
+template< class SrcIt, class PermIt, class DstIt>
+void parallelGather(SrcIt src, PermIt perm, size_t n, DstIt dst, size_t threads = 0) {
+  parallelGather(defaultExecutor(), src, perm, n, dst, threads);
+}
+
+// parallelScatter sets dst[perm[i]] = src[i] for i in [0, n).  perm must be a permutation and dst must not overlap src.
+// With more than one thread and a dst larger than the cache, the records are first bucketed by destination block of about
+// 256KB, the way a radix sort buckets keys: per-thread counts, a scan, and a copy of each record with its destination to
+// its bucket, which is a sequential write for each thread.  Then each block is written by one thread while it is in the
+// cache, instead of every thread writing all over dst.  The bucketing costs a pass over a staging array of n records and
+// destinations, so one thread, which has the memory system to itself, and small arrays scatter directly with prefetching.
+template< class E, class SrcIt, class PermIt, class DstIt, typename std::enable_if<isExecutor<E>::value, int>::type = 0>
+void parallelScatter(E& exec, SrcIt src, PermIt perm, size_t n, DstIt dst, size_t threads = 0) {
+  typedef typename std::iterator_traits<SrcIt>::value_type T;
+  if (threads == 0) threads = exec.concurrency();
+  const size_t blockElems = std::max<size_t>((size_t)(256 * 1024) / sizeof(T), 1);
+  const size_t blocks = (n + blockElems - 1) / blockElems;
+  if (threads <= 1 || blocks <= 4 || n * sizeof(T) <= ((size_t)8 << 20)) {
+    parallelForRange(exec, (size_t)0, n, [&](size_t lb, size_t le) {
+      size_t i = lb;
+      for (; i + permutePrefetchDistance < le; i++) {
+        permutePrefetchWrite(&*(dst + *(perm + i + permutePrefetchDistance)));
+        *(dst + *(perm + i)) = *(src + i);
+      }
+      for (; i < le; i++) *(dst + *(perm + i)) = *(src + i);
+      }, 4096, schedStatic, (int64_t)threads);
+    return;
+  }
+
+  threads = std::max<size_t>(std::min(threads, n / 4096), 1);
+  const double delta = double(n) / double(threads);
+  auto bound = [n, delta, threads](size_t t) { return t >= threads ? n : (size_t)llround(double(t) * delta); };
+  std::vector<size_t> counts(blocks * threads, 0);
+  parallelFor(exec, (int64_t)0, (int64_t)threads, [&](int64_t t) {
+    for (size_t i = bound(t); i < bound(t + 1); i++) counts[(size_t)*(perm + i) / blockElems * threads + t]++;
+    }, threads);
+  parallelExclusiveScan(exec, counts.begin(), counts.end(), counts.begin(), (size_t)0, std::plus<size_t>(), 4096, threads);
+  std::vector<size_t> blockStart(blocks + 1);
+  for (size_t b = 0; b < blocks; b++) blockStart[b] = counts[b * threads];
+  blockStart[blocks] = n;
+
+  // the records are staged with their destinations, a bucket of sequential writes per block for each thread.
+  std::vector<std::pair<size_t, T>> staged(n);
+  parallelFor(exec, (int64_t)0, (int64_t)threads, [&](int64_t t) {
+    for (size_t i = bound(t); i < bound(t + 1); i++) {
+      size_t d = (size_t)*(perm + i);
+      auto& s = staged[counts[d / blockElems * threads + t]++];
+      s.first = d;
+      s.second = *(src + i);
+    }
+    }, threads);
+
+  parallelForRange(exec, (size_t)0, blocks, [&](size_t bl, size_t be) {
+    for (size_t j = blockStart[bl]; j < blockStart[be]; j++) *(dst + staged[j].first) = std::move(staged[j].second);
+    }, 1, schedDynamic, (int64_t)threads);
+}
+
+template< class SrcIt, class PermIt, class DstIt>
+void parallelScatter(SrcIt src, PermIt perm, size_t n, DstIt dst, size_t threads = 0) {
+  parallelScatter(defaultExecutor(), src, perm, n, dst, threads);
+}
+
+// parallelPermuteInPlace sets data[i] to the old data[perm[i]] for i in [0, n), the same as parallelGather into a copy,
+// using n bits of extra memory instead of n records.  Each thread looks at the positions in its part of the range and
+// rotates the records around the cycle of the permutation that each one is on.  A cycle is rotated only by the thread
+// that owns its smallest position, so no two threads move the same cycle, and the positions it moves are marked in a
+// visited bitmap so that later starts on the same cycle are skipped right away.  A permutation with a few long cycles,
+// such as a random one, has little parallelism, since each cycle is rotated by one thread.
+template< class E, class RandomIt, class PermIt, typename std::enable_if<isExecutor<E>::value, int>::type = 0>
+void parallelPermuteInPlace(E& exec, RandomIt data, PermIt perm, size_t n, size_t threads = 0) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  std::vector<std::atomic<uint64_t>> visited((n + 63) / 64);
+  for (auto& word : visited) word.store(0, std::memory_order_relaxed);
+  auto isVisited = [&visited](size_t i) { return (visited[i / 64].load(std::memory_order_relaxed) >> (i % 64)) & 1; };
+  auto markVisited = [&visited](size_t i) { visited[i / 64].fetch_or((uint64_t)1 << (i % 64), std::memory_order_relaxed); };
+
+  parallelForRange(exec, (size_t)0, n, [&](size_t lb, size_t le) {
+    for (size_t i = lb; i < le; i++) {
+      if (isVisited(i)) continue;
+      // i leads its cycle if no position on the cycle is smaller.  The cycles through [0, i) have all been rotated by the time
+      // the first chunk gets to i, so there it is the leader without the walk.
+      bool leader = true;
+      if (lb != 0) for (size_t j = (size_t)*(perm + i); j != i; j = (size_t)*(perm + j)) {
+        if (j < i) {
+          leader = false;
+          break;
+        }
+      }
+      if (!leader) continue;
+      T first = std::move(*(data + i));
+      size_t j = i;
+      while (true) {
+        markVisited(j);
+        size_t k = (size_t)*(perm + j);
+        if (k == i) {
+          *(data + j) = std::move(first);
+          break;
+        }
+        *(data + j) = std::move(*(data + k));
+        j = k;
+      }
+    }
+    }, 4096, schedStatic, (int64_t)threads);
+}
+
+template< class RandomIt, class PermIt>
+void parallelPermuteInPlace(RandomIt data, PermIt perm, size_t n, size_t threads = 0) {
+  parallelPermuteInPlace(defaultExecutor(), data, perm, n, threads);
+}
+
+#endif // PARALLELPERMUTE_HPP
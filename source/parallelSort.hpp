@@ -13,8 +13,26 @@
 #include <cstring>
 #include <stdint.h>
 #include <algorithm>    // std::swap
+#include <utility>      // std::pair
 #include <cmath>        // log2
+#include <memory>       // std::unique_ptr
+#include <limits>
+#include <condition_variable>
+#include <vector>
+#include <array>
 #include "parallelFor.hpp"
+#include "sortFixed.hpp"
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MERGE_STREAM_STORES
+#endif
+#if defined(__GNUC__) || defined(__clang__)
+#define mergePrefetch(p) __builtin_prefetch((p), 0)
+#elif defined(MERGE_STREAM_STORES)
+#define mergePrefetch(p) _mm_prefetch((const char*)(p), _MM_HINT_T0)
+#else
+#define mergePrefetch(p) ((void)0)
+#endif
 
 #define sortFor false
 #define sortRev true
@@ -32,6 +50,41 @@ inline size_t iDivUp(size_t a, size_t b)
   return ((a % b) == 0) ? (a / b) : (a / b + 1);
 }
 
+// splitThreads divides a budget of threads between tasks of the given sizes, in proportion to their sizes.
+// Each task gets at least one thread and the shares add up to exactly budget, so nested parallel calls that
+// use their shares never run more threads than the budget.  The threads left after rounding down go to the
+// tasks with the largest remainders.  There must be no more tasks than threads in the budget.
+inline std::vector<size_t> splitThreads(size_t budget, const std::vector<size_t>& sizes) {
+  const size_t n = sizes.size();
+  std::vector<size_t> shares(n, 1);
+  if (n == 0 || budget <= n) return shares;
+  double total = 0.0;
+  for (size_t s : sizes) total += double(s);
+  const size_t spare = budget - n;
+  std::vector<std::pair<double, size_t>> remainders(n);
+  size_t given = 0;
+  for (size_t i = 0; i < n; i++) {
+    double want = total > 0.0 ? double(spare) * double(sizes[i]) / total : double(spare) / double(n);
+    size_t whole = (size_t)want;
+    shares[i] += whole;
+    given += whole;
+    remainders[i] = { want - double(whole), i };
+  }
+  std::sort(remainders.begin(), remainders.end(), [](const std::pair<double, size_t>& x, const std::pair<double, size_t>& y) {
+    return x.first > y.first || (x.first == y.first && x.second < y.second);
+    });
+  for (size_t i = 0; given < spare; i = (i + 1) % n, given++) shares[remainders[i].second]++;
+  return shares;
+}
+
+// mergePrefetchDistance() is how many elements ahead of the merge mergeFF prefetches what the pointers of each range
+// point at, when the values are pointers.  A comparison of pointers such as std::string* or record* reads two random
+// heap addresses, so without prefetches the merge runs at the latency of memory.  0 turns the prefetches off.
+inline size_t& mergePrefetchDistance() {
+  static size_t distance = 8;
+  return distance;
+}
+
 // mergeFF merges two sorted ranges in the src array into a single sorted range in the dst array
 // aBeg and aEnd inclusive indicate one sorted range 
 // bBeg and bEnd inclusive indicate the other sorted range
@@ -40,7 +93,7 @@ inline size_t iDivUp(size_t a, size_t b)
 // to cap the merge function.  After than, the reset of the other array is just copied to the dst array
 // The two ranges being merged do not have to be adjacent in memory.
 template< class RandomItD, class RandomItS, class CF>
-inline void mergeFF(RandomItD dst, RandomItS src, size_t aBeg, size_t aEnd, size_t bBeg, size_t bEnd, size_t dBeg, CF compFunc) {
+inline void mergeFF(RandomItD dst, RandomItS src, size_t aBeg, size_t aEnd, size_t bBeg, size_t bEnd, size_t dBeg, CF compFunc, std::false_type) {
   if (compFunc(*(src + aEnd), *(src + bEnd))) { // determine which range will be completed first during a compare and copy loop
     while (aBeg <= aEnd) {  // the a range will be completely copied first so only compare up the end of a
       *(dst + dBeg++) = !compFunc(*(src + bBeg), *(src + aBeg)) ? *(src + aBeg++) : *(src + bBeg++);
@@ -59,6 +112,138 @@ inline void mergeFF(RandomItD dst, RandomItS src, size_t aBeg, size_t aEnd, size
   }
 }
 
+template< class RandomItD, class RandomItS, class CF>
+inline void mergeFF(RandomItD dst, RandomItS src, size_t aBeg, size_t aEnd, size_t bBeg, size_t bEnd, size_t dBeg, CF compFunc, std::true_type) {
+  const size_t d = mergePrefetchDistance();
+  if (d == 0) {
+    mergeFF(dst, src, aBeg, aEnd, bBeg, bEnd, dBeg, compFunc, std::false_type());
+    return;
+  }
+  for (size_t i = 1; i < d; i++) {  // start the prefetches of the first d elements of each range
+    mergePrefetch(*(src + minimum(aBeg + i, aEnd)));
+    mergePrefetch(*(src + minimum(bBeg + i, bEnd)));
+  }
+  if (compFunc(*(src + aEnd), *(src + bEnd))) {
+    while (aBeg <= aEnd) {
+      mergePrefetch(*(src + minimum(aBeg + d, aEnd)));
+      mergePrefetch(*(src + minimum(bBeg + d, bEnd)));
+      *(dst + dBeg++) = !compFunc(*(src + bBeg), *(src + aBeg)) ? *(src + aBeg++) : *(src + bBeg++);
+    }
+    while (bBeg <= bEnd) {
+      *(dst + dBeg++) = *(src + bBeg++);
+    }
+  }
+  else {
+    while (bBeg <= bEnd) {
+      mergePrefetch(*(src + minimum(aBeg + d, aEnd)));
+      mergePrefetch(*(src + minimum(bBeg + d, bEnd)));
+      *(dst + dBeg++) = compFunc(*(src + aBeg), *(src + bBeg)) ? *(src + aBeg++) : *(src + bBeg++);
+    }
+    while (aBeg <= aEnd) {
+      *(dst + dBeg++) = *(src + aBeg++);
+    }
+  }
+}
+
+// mergeFF prefetches through the values of the ranges when they are pointers.
+template< class RandomItD, class RandomItS, class CF>
+inline void mergeFF(RandomItD dst, RandomItS src, size_t aBeg, size_t aEnd, size_t bBeg, size_t bEnd, size_t dBeg, CF compFunc) {
+  typedef typename std::iterator_traits<RandomItS>::value_type T;
+  mergeFF(dst, src, aBeg, aEnd, bBeg, bEnd, dBeg, compFunc, std::integral_constant<bool, std::is_pointer<T>::value>());
+}
+
+
+// Each merge level reads the whole array and writes the whole array.  With normal stores every destination cache
+// line is first read into the cache, which is a third read pass, and then pushes out source data that is still to
+// be merged.  When the merge output is larger than mergeStreamBytes(), and the values are trivially copyable and
+// in plain arrays, mergeFFStream merges into a small buffer that stays in the L1 cache and copies it out with
+// streamStore, which uses non-temporal stores that write whole lines to memory without reading them first.  On
+// x86-64 the SSE2 stores are always there, so no run time check is needed, and on other targets streamStore is a
+// memcpy.  Set mergeStreamBytes() to SIZE_MAX to turn the streaming merges off.
+inline size_t& mergeStreamBytes() {
+  static size_t bytes = (size_t)32 << 20;
+  return bytes;
+}
+
+const size_t mergeStreamBufferBytes = 4096;
+
+// streamStore copies bytes from src to dst, with non-temporal stores for the 16 byte aligned part of dst.
+inline void streamStore(void* dst, const void* src, size_t bytes) {
+#ifdef MERGE_STREAM_STORES
+  char* d = (char*)dst;
+  const char* s = (const char*)src;
+  size_t head = minimum((16 - (uintptr_t)d % 16) % 16, bytes);
+  memcpy(d, s, head);
+  d += head;
+  s += head;
+  bytes -= head;
+  for (; bytes >= 16; bytes -= 16, d += 16, s += 16) _mm_stream_si128((__m128i*)d, _mm_loadu_si128((const __m128i*)s));
+  memcpy(d, s, bytes);
+#else
+  memcpy(dst, src, bytes);
+#endif
+}
+
+// streamFence orders the non-temporal stores before the stores that follow, such as the ones that tell other threads
+// that a merge is done.
+inline void streamFence() {
+#ifdef MERGE_STREAM_STORES
+  _mm_sfence();
+#endif
+}
+
+// mergeStreams tells whether merges from src to dst can use mergeFFStream.  Merges of pointers are left to the prefetching
+// mergeFF, since they are bound by the latency of what the pointers point at rather than by bandwidth.  Without
+// MERGE_STREAM_STORES the buffer of mergeFFStream would be copied out with ordinary stores, so every merge uses mergeFF.
+template<class RandomItD, class RandomItS>
+constexpr bool mergeStreams() {
+#ifdef MERGE_STREAM_STORES
+  typedef typename std::iterator_traits<RandomItS>::value_type T;
+  return std::is_pointer<RandomItD>::value && std::is_pointer<RandomItS>::value && std::is_trivially_copyable<T>::value && !std::is_pointer<T>::value &&
+    std::is_same<typename std::iterator_traits<RandomItD>::value_type, T>::value;
+#else
+  return false;
+#endif
+}
+
+// mergeFFStream merges [aBeg, aEnd) and [bBeg, bEnd) of src to dst from dBeg, through a buffer copied out with
+// streamStore.  Each pass merges as many values as it can without running out of either range, up to the size of the
+// buffer, so the inner loop has no checks of the range ends.  The rest of the range that is left is copied straight
+// from src.
+template< class T, class CF>
+inline void mergeFFStream(T* dst, const T* src, size_t aBeg, size_t aEnd, size_t bBeg, size_t bEnd, size_t dBeg, CF compFunc) {
+  const size_t bufElems = maximum(mergeStreamBufferBytes / sizeof(T), 1);
+  alignas(64) unsigned char raw[mergeStreamBufferBytes + sizeof(T)];
+  T* buf = (T*)raw;
+  while (aBeg < aEnd && bBeg < bEnd) {
+    const size_t count = minimum(bufElems, minimum(aEnd - aBeg, bEnd - bBeg));
+    for (size_t i = 0; i < count; i++) buf[i] = compFunc(src[bBeg], src[aBeg]) ? src[bBeg++] : src[aBeg++];
+    streamStore(dst + dBeg, buf, count * sizeof(T));
+    dBeg += count;
+  }
+  if (aBeg < aEnd) streamStore(dst + dBeg, src + aBeg, (aEnd - aBeg) * sizeof(T));
+  else if (bBeg < bEnd) streamStore(dst + dBeg, src + bBeg, (bEnd - bBeg) * sizeof(T));
+  streamFence();
+}
+
+// mergePartition merges the partition [a0, a1) and [b0, b1) of parallelMerge to dst from wtid, streamed or not.
+template< class RandomItD, class RandomItS, class CF>
+inline void mergePartition(RandomItD dst, RandomItS src, size_t a0, size_t a1, size_t b0, size_t b1, size_t wtid, CF compFunc, std::false_type) {
+  if (a0 == a1) {							// If no a data just copy b
+    for (size_t b = b0; b < b1; b++) dst[wtid++] = src[b];
+  }
+  else if (b0 == b1) {					// If no b data just copy a
+    for (size_t a = a0; a < a1; a++) dst[wtid++] = src[a];
+  }
+  else { // else do a merge using the forward-forward merge
+    mergeFF(dst, src, a0, a1 - 1, b0, b1 - 1, wtid, compFunc);
+  }
+}
+
+template< class T, class CF>
+inline void mergePartition(T* dst, const T* src, size_t a0, size_t a1, size_t b0, size_t b1, size_t wtid, CF compFunc, std::true_type) {
+  mergeFFStream(dst, src, a0, a1, b0, b1, wtid, compFunc);
+}
 
 // ParallelMerge and it's supporting functions getMergePaths and mergePath are a CPU implementation of
 // parallel merge function developed for GPUs described in "GPU Merge Path: A GPU Merging Algorithm" by Greenand, McColl, and Bader.
@@ -73,6 +258,14 @@ size_t mergePath(RandomIt valA, int64_t aCount, RandomIt valB, int64_t bCount, i
 
   while (begin < end) {
     size_t mid = begin + ((end - begin) >> 1);
+    // prefetch the values of both possible next midpoints while this one is compared
+    size_t lo = begin + ((mid - begin) >> 1), hi = mid + 1 + ((end - mid - 1) >> 1);
+    mergePrefetch(&*(valA + lo));
+    mergePrefetch(&*(valB + (diag - 1 - lo)));
+    if (hi < end) {
+      mergePrefetch(&*(valA + hi));
+      mergePrefetch(&*(valB + (diag - 1 - hi)));
+    }
     bool pred = compFunc(*(valA + mid), *(valB + (diag - 1 - mid)));
     if (pred) begin = mid + 1;
     else end = mid;
@@ -96,14 +289,54 @@ inline void getMergePaths(size_t mpi[], RandomIt valA, int64_t aCount, RandomIt
   }
 }
 
+// mergeGate is used by background sorts to limit the number of merge partitions that run at the same time,
+// which caps the memory bandwidth the sort takes from other work, and to yield the core after each partition.
+// A limit of 0 means no limit.
+class mergeGate {
+  std::mutex lock_;
+  std::condition_variable cv_;
+  int64_t slots_;
+  bool limited_;
+  bool yield_;
+
+public:
+  mergeGate(int64_t limit, bool yieldBetweenPartitions)
+    : slots_(limit), limited_(limit > 0), yield_(yieldBetweenPartitions) {}
+
+  void enter() {
+    if (!limited_) return;
+    std::unique_lock<std::mutex> guard(lock_);
+    cv_.wait(guard, [this] { return slots_ > 0; });
+    slots_--;
+  }
+
+  void leave() {
+    if (limited_) {
+      std::lock_guard<std::mutex> guard(lock_);
+      slots_++;
+      cv_.notify_one();
+    }
+    if (yield_) std::this_thread::yield();
+  }
+};
+
+// the mergeGate that parallelSort uses on this thread, set by parallelSortBackground.
+inline mergeGate*& currentMergeGate() {
+  thread_local mergeGate* gate = nullptr;
+  return gate;
+}
+
 // parallelMerge() merges two sorted ranges in the src array into a single sorted range in the dst array
 // aBeg and aEnd inclusive indicate one sorted range in the src array 
 // bBeg and bEnd inclusive indicate the other sorted range in the src array
 // dBeg indicates where in the dst array the merge list should start
 // After determining the ranges of the src segments that will go nto each output segment, use the mergeFF() function to 
 // merge those segments in parallel.
-template< class RandomItS, class RandomItD, class CF>
-inline void parallelMerge(RandomItD dst, RandomItS src, size_t aBeg, size_t aEnd, size_t bBeg, size_t bEnd, size_t dBeg, CF compFunc, size_t threads) {
+// If gate is not null, each partition of the merge passes through it.
+// The partitions run on exec, or on the default executor when none is given.
+template< class E, class RandomItS, class RandomItD, class CF, typename std::enable_if<isExecutor<E>::value, int>::type = 0>
+inline void parallelMerge(E& exec, RandomItD dst, RandomItS src, size_t aBeg, size_t aEnd, size_t bBeg, size_t bEnd, size_t dBeg, CF compFunc, size_t threads,
+  mergeGate* gate = nullptr) {
 
   size_t mpi[1024];  // an array that hold the range of indicies in tha a array for each segment of output to dst..
 
@@ -111,8 +344,10 @@ inline void parallelMerge(RandomItD dst, RandomItS src, size_t aBeg, size_t aEnd
   int64_t bCount = bEnd - bBeg + 1;
   double spacing = static_cast<double>(aCount + bCount) / static_cast<double>(threads);
   getMergePaths(mpi, src + aBeg, aCount, src + bBeg, bCount, spacing, compFunc, threads);
+  typedef typename std::iterator_traits<RandomItS>::value_type T;
+  const bool stream = mergeStreams<RandomItD, RandomItS>() && threads > 1 && (size_t)(aCount + bCount) * sizeof(T) >= mergeStreamBytes();
 
-  parallelFor((int64_t)0, (int64_t)threads, [&](int64_t thread) {
+  parallelFor(exec, (int64_t)0, (int64_t)threads, [&](int64_t thread) {
     double dthread = static_cast<double>(thread);
     size_t grid = llround(dthread * spacing);		// Calculate the relevant index ranges into the source array
     size_t a0 = mpi[thread] + aBeg;			// for this partition
@@ -122,16 +357,535 @@ inline void parallelMerge(RandomItD dst, RandomItS src, size_t aBeg, size_t aEnd
     size_t b1 = (llround((dthread + 1.0) * spacing) - mpi[thread + 1]) + bBeg;
     size_t wtid = dBeg + grid;  //Place where this thread will start writing the data
 
-    if (a0 == a1) {							// If no a data just copy b
-      for (size_t b = b0; b < b1; b++) dst[wtid++] = src[b];
+    if (gate != nullptr) gate->enter();
+    if (stream) mergePartition(dst, src, a0, a1, b0, b1, wtid, compFunc, std::integral_constant<bool, mergeStreams<RandomItD, RandomItS>()>());
+    else mergePartition(dst, src, a0, a1, b0, b1, wtid, compFunc, std::false_type());
+    if (gate != nullptr) gate->leave();
+    }, threads);
+}
+
+template< class RandomItS, class RandomItD, class CF>
+inline void parallelMerge(RandomItD dst, RandomItS src, size_t aBeg, size_t aEnd, size_t bBeg, size_t bEnd, size_t dBeg, CF compFunc, size_t threads,
+  mergeGate* gate = nullptr) {
+  parallelMerge(defaultExecutor(), dst, src, aBeg, aEnd, bBeg, bEnd, dBeg, compFunc, threads, gate);
+}
+
+// mergePathStable is the version of mergePath used by the stable merges.  Equal elements are taken from the
+// a range first, so it returns the number of elements of valA that are among the first diag outputs of a
+// merge that keeps the elements of valA ahead of equal elements of valB.  valA and valB may be different types.
+template <class RandomItA, class RandomItB, class CF>
+size_t mergePathStable(RandomItA valA, int64_t aCount, RandomItB valB, int64_t bCount, int64_t diag, CF compFunc) {
+
+  size_t begin = maximum(0, diag - bCount);
+  size_t end = minimum(diag, aCount);
+
+  while (begin < end) {
+    size_t mid = begin + ((end - begin) >> 1);
+    bool pred = !compFunc(*(valB + (diag - 1 - mid)), *(valA + mid));
+    if (pred) begin = mid + 1;
+    else end = mid;
+  }
+  return begin;
+}
+
+// parallelMergeStable() is the stable version of parallelMerge().  It takes the same arguments, and when elements
+// of the a and b ranges are equal the ones from the a range are placed first.
+template< class E, class RandomItS, class RandomItD, class CF, typename std::enable_if<isExecutor<E>::value, int>::type = 0>
+inline void parallelMergeStable(E& exec, RandomItD dst, RandomItS src, size_t aBeg, size_t aEnd, size_t bBeg, size_t bEnd, size_t dBeg, CF compFunc, size_t threads) {
+
+  int64_t aCount = aEnd - aBeg + 1;
+  int64_t bCount = bEnd - bBeg + 1;
+  double spacing = static_cast<double>(aCount + bCount) / static_cast<double>(threads);
+  std::vector<size_t> mpi(threads + 1);
+  mpi[0] = 0;
+  mpi[threads] = aCount;
+  for (size_t i = 1; i < threads; i++) mpi[i] = mergePathStable(src + aBeg, aCount, src + bBeg, bCount, llround(i * spacing), compFunc);
+
+  parallelFor(exec, (int64_t)0, (int64_t)threads, [&](int64_t thread) {
+    size_t grid = llround(thread * spacing);
+    size_t gridEnd = thread == (int64_t)threads - 1 ? (size_t)(aCount + bCount) : (size_t)llround((thread + 1) * spacing);
+    size_t a0 = mpi[thread] + aBeg;
+    size_t a1 = mpi[thread + 1] + aBeg;
+    size_t b0 = (grid - mpi[thread]) + bBeg;
+    size_t b1 = (gridEnd - mpi[thread + 1]) + bBeg;
+    std::merge(src + a0, src + a1, src + b0, src + b1, dst + (dBeg + grid), compFunc);
+    }, threads);
+}
+
+// mergeDiagonalByWeight returns the first diagonal of the merge of valA and valB at which the weight of the merged values
+// reaches target.  prefA[i] and prefB[i] are the weights of the first i values of each range.  The weight along the merge
+// path only grows, so the diagonal is found with a binary search of mergePath calls.
+template <class RandomIt, class CF>
+int64_t mergeDiagonalByWeight(RandomIt valA, int64_t aCount, RandomIt valB, int64_t bCount, const uint64_t* prefA, const uint64_t* prefB,
+  uint64_t target, CF compFunc) {
+  int64_t lo = 0, hi = aCount + bCount;
+  while (lo < hi) {
+    int64_t diag = lo + ((hi - lo) >> 1);
+    size_t a = mergePath(valA, aCount, valB, bCount, diag, compFunc, 1);
+    if (prefA[a] - prefA[0] + prefB[diag - a] - prefB[0] < target) lo = diag + 1;
+    else hi = diag;
+  }
+  return lo;
+}
+
+// parallelMergeWeighted is parallelMerge with the output split between the threads by weight instead of by count.
+// prefix[i] is the sum of the weights of the values of src before position i, so the partitions of a merge of long and
+// short strings have about the same number of bytes instead of the same number of strings.
+template< class E, class RandomItS, class RandomItD, class CF, typename std::enable_if<isExecutor<E>::value, int>::type = 0>
+inline void parallelMergeWeighted(E& exec, RandomItD dst, RandomItS src, size_t aBeg, size_t aEnd, size_t bBeg, size_t bEnd, size_t dBeg,
+  CF compFunc, const uint64_t* prefix, size_t threads) {
+
+  int64_t aCount = aEnd - aBeg + 1;
+  int64_t bCount = bEnd - bBeg + 1;
+  const uint64_t total = prefix[aEnd + 1] - prefix[aBeg] + prefix[bEnd + 1] - prefix[bBeg];
+  std::vector<size_t> mpi(threads + 1), diags(threads + 1);
+  mpi[0] = diags[0] = 0;
+  mpi[threads] = aCount;
+  diags[threads] = aCount + bCount;
+  for (size_t i = 1; i < threads; i++) {
+    uint64_t target = (uint64_t)llround(double(total) * double(i) / double(threads));
+    diags[i] = mergeDiagonalByWeight(src + aBeg, aCount, src + bBeg, bCount, prefix + aBeg, prefix + bBeg, target, compFunc);
+    mpi[i] = mergePath(src + aBeg, aCount, src + bBeg, bCount, diags[i], compFunc, threads);
+  }
+
+  parallelFor(exec, (int64_t)0, (int64_t)threads, [&](int64_t thread) {
+    size_t a0 = mpi[thread] + aBeg;
+    size_t a1 = mpi[thread + 1] + aBeg;
+    size_t b0 = (diags[thread] - mpi[thread]) + bBeg;
+    size_t b1 = (diags[thread + 1] - mpi[thread + 1]) + bBeg;
+    mergePartition(dst, src, a0, a1, b0, b1, dBeg + diags[thread], compFunc, std::false_type());
+    }, threads);
+}
+
+// countingSortable is true for the integral types whose values the counting and narrow sorts can take the difference of
+// in a uint64_t, which are those of 64 bits or less.  A 128 bit integer is sorted with comparisons.
+template<class T> struct countingSortable : std::integral_constant<bool, std::is_integral<T>::value && sizeof(T) <= 8> {};
+
+// countingSortOrder tells parallelSort when it may replace the sort with a counting sort: for countingSortable types
+// compared with std::less (order 1) or std::greater (order -1).  With any other comparison the order is 0, and the
+// counting sort is never used, since the comparison might not be the natural order of the values.
+template<class T, class CF> struct countingSortOrder { static const int value = 0; };
+template<class T> struct countingSortOrder<T, std::less<T>> { static const int value = countingSortable<T>::value ? 1 : 0; };
+template<class T> struct countingSortOrder<T, std::greater<T>> { static const int value = countingSortable<T>::value ? -1 : 0; };
+template<class T> struct countingSortOrder<T, std::less<>> { static const int value = countingSortable<T>::value ? 1 : 0; };
+template<class T> struct countingSortOrder<T, std::greater<>> { static const int value = countingSortable<T>::value ? -1 : 0; };
+
+// countingSortFits decides whether a counting sort of len values that span maxV - minV with threads per-thread histograms
+// is worth it: the histograms together must be no more than half the size of the data and at most 2^20 counts each.
+// The span is checked before a count is added to it, since it is 2^64 - 1 for values from 0 to UINT64_MAX.
+inline bool countingSortFits(size_t len, uint64_t span, size_t threads) {
+  return span < ((uint64_t)1 << 20) && (span + 1) * threads <= len / 2;
+}
+
+// parallelCountingSort sorts integral values from minV to maxV, ascending or descending, by counting them.  Each thread
+// counts the values in its part of the range in its own histogram, the histograms are summed and scanned to give the
+// first position of each value, and then each thread fills its part of the output with the values that belong there.
+template< class E, class RandomIt, typename std::enable_if<isExecutor<E>::value, int>::type = 0>
+void parallelCountingSort(E& exec, RandomIt begin, RandomIt end, typename std::iterator_traits<RandomIt>::value_type minV,
+  typename std::iterator_traits<RandomIt>::value_type maxV, bool descending, size_t threads = 0) {
+
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  static_assert(countingSortable<T>::value, "parallelCountingSort needs an integral type of 64 bits or less");
+  if (threads == 0) threads = exec.concurrency();
+  const size_t len = end - begin;
+  if (len < 2) return;
+  const size_t range = (size_t)((uint64_t)maxV - (uint64_t)minV) + 1;
+  threads = maximum(minimum(threads, len / 4096), 1);
+  const double delta = double(len) / double(threads);
+  auto bound = [len, delta, threads](size_t t) { return t >= threads ? len : (size_t)llround(double(t) * delta); };
+  // key k of value v is its distance from the first value in the sort order.
+  auto key = [minV, maxV, descending](T v) { return descending ? (size_t)((uint64_t)maxV - (uint64_t)v) : (size_t)((uint64_t)v - (uint64_t)minV); };
+
+  std::vector<size_t> counts(range * threads, 0);
+  parallelFor(exec, (int64_t)0, (int64_t)threads, [&](int64_t t) {
+    size_t* hist = counts.data() + t * range;
+    for (size_t i = bound(t); i < bound(t + 1); i++) hist[key(*(begin + i))]++;
+    }, threads);
+
+  // sum the histograms into the first one and scan it into the start of each key.
+  std::vector<size_t> start(range + 1);
+  parallelForRange(exec, (size_t)0, range, [&](size_t lb, size_t le) {
+    for (size_t k = lb; k < le; k++) {
+      size_t total = 0;
+      for (size_t t = 0; t < threads; t++) total += counts[t * range + k];
+      start[k] = total;
+    }
+    }, 4096, schedStatic, threads);
+  start[range] = 0;
+  parallelExclusiveScan(exec, start.begin(), start.end(), start.begin(), (size_t)0, std::plus<size_t>(), 4096, threads);
+
+  parallelForRange(exec, (size_t)0, len, [&](size_t lb, size_t le) {
+    size_t k = std::upper_bound(start.begin(), start.end() - 1, lb) - start.begin() - 1;
+    size_t i = lb;
+    while (i < le) {
+      size_t stop = minimum(start[k + 1], le);
+      T v = descending ? (T)((uint64_t)maxV - (uint64_t)k) : (T)((uint64_t)minV + (uint64_t)k);
+      std::fill(begin + i, begin + stop, v);
+      i = stop;
+      k++;
     }
-    else if (b0 == b1) {					// If no b data just copy a
-      for (size_t a = a0; a < a1; a++) dst[wtid++] = src[a];
+    }, 4096, schedStatic, threads);
+}
+
+// parallelMinMax returns the smallest and largest values of [begin, end), which must not be empty.
+template< class E, class RandomIt, typename std::enable_if<isExecutor<E>::value, int>::type = 0>
+std::pair<typename std::iterator_traits<RandomIt>::value_type, typename std::iterator_traits<RandomIt>::value_type>
+parallelMinMax(E& exec, RandomIt begin, RandomIt end, size_t threads = 0) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  typedef std::pair<T, T> range;
+  return parallelTransformReduce(exec, begin, end, range(*begin, *begin),
+    [](const range& a, const range& b) { return range(minimum(a.first, b.first), maximum(a.second, b.second)); },
+    [](T v) { return range(v, v); }, 4096, (int64_t)threads);
+}
+
+// narrowLess is std::less for the narrow keys of parallelNarrowSort.  It is a type of its own so that sorting the
+// keys does not try the counting and narrow sorts again.
+struct narrowLess {
+  template<class U>
+  bool operator()(const U& a, const U& b) const { return a < b; }
+};
+
+// parallelNarrowSort sorts integral values from minV to maxV through keys of the unsigned type U, which must hold
+// maxV - minV.  The values are encoded as their distance from minV, or from maxV when descending, in parallel, the
+// keys are sorted with parallelSort, and the values are decoded back in parallel.  Every merge pass then moves
+// sizeof(U) bytes per value instead of sizeof(T), such as 4 instead of 8 for int64_t values with a 32 bit range.
+template< class U, class E, class RandomIt, typename std::enable_if<isExecutor<E>::value, int>::type = 0>
+void parallelNarrowSort(E& exec, RandomIt begin, RandomIt end, typename std::iterator_traits<RandomIt>::value_type minV,
+  typename std::iterator_traits<RandomIt>::value_type maxV, bool descending, size_t threads) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  static_assert(countingSortable<T>::value, "parallelNarrowSort needs an integral type of 64 bits or less");
+  const size_t len = end - begin;
+  std::vector<U> keys(len);
+  parallelForRange(exec, (size_t)0, len, [&](size_t lb, size_t le) {
+    if (descending) for (size_t i = lb; i < le; i++) keys[i] = (U)((uint64_t)maxV - (uint64_t)*(begin + i));
+    else for (size_t i = lb; i < le; i++) keys[i] = (U)((uint64_t)*(begin + i) - (uint64_t)minV);
+    }, 4096, schedStatic, threads);
+  parallelSort(exec, keys.data(), keys.data() + len, narrowLess(), threads);
+  parallelForRange(exec, (size_t)0, len, [&](size_t lb, size_t le) {
+    if (descending) for (size_t i = lb; i < le; i++) *(begin + i) = (T)((uint64_t)maxV - (uint64_t)keys[i]);
+    else for (size_t i = lb; i < le; i++) *(begin + i) = (T)((uint64_t)minV + (uint64_t)keys[i]);
+    }, 4096, schedStatic, threads);
+}
+
+// integerSortKind is the sort without comparisons that integerSortPlan picks for integral values.
+enum integerSortKind { integerSortNone, integerSortCounting, integerSortNarrow16, integerSortNarrow32 };
+
+// integerSortPlan finds the smallest and largest values of [begin, end) in parallel and picks parallelCountingSort when
+// the range is small next to len, or parallelNarrowSort when the range fits in a narrower type than T, with the range
+// in r.  A sample of the values is checked first so that data with a range too wide for either costs only a few
+// hundred reads.  It does not change the data.
+template< class E, class RandomIt>
+integerSortKind integerSortPlan(E& exec, RandomIt begin, RandomIt end, size_t threads,
+  std::pair<typename std::iterator_traits<RandomIt>::value_type, typename std::iterator_traits<RandomIt>::value_type>& r) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  const size_t len = end - begin;
+  if (len < 4096) return integerSortNone;
+  const size_t histograms = maximum(minimum(threads, len / 4096), 1);
+  // the widest range that a narrower key can hold, or 0 if there is no narrower key.  Narrow keys pay for their
+  // encode and decode passes in the merge passes, so they are only used when there is more than one thread.
+  const bool narrow = threads > 1;
+  const uint64_t narrowRange = !narrow ? 0 : (sizeof(T) > 4 ? 0xFFFFFFFFull : (sizeof(T) > 2 ? 0xFFFFull : 0));
+  T lo = *begin, hi = *begin;
+  for (size_t i = 0; i < 256; i++) {
+    T v = *(begin + i * (len / 256));
+    lo = minimum(lo, v);
+    hi = maximum(hi, v);
+  }
+  uint64_t span = (uint64_t)hi - (uint64_t)lo;
+  if (span > narrowRange && !countingSortFits(len, span, histograms)) return integerSortNone;
+
+  r = parallelMinMax(exec, begin, end, threads);
+  span = (uint64_t)r.second - (uint64_t)r.first;
+  if (countingSortFits(len, span, histograms)) return integerSortCounting;
+  if (narrow && span <= 0xFFFFull && sizeof(T) > 2) return integerSortNarrow16;
+  if (narrow && span <= 0xFFFFFFFFull && sizeof(T) > 4) return integerSortNarrow32;
+  return integerSortNone;
+}
+
+// runIntegerSort sorts [begin, end), whose values are from r.first to r.second, with the sort picked by integerSortPlan.
+template< class E, class RandomIt>
+void runIntegerSort(E& exec, RandomIt begin, RandomIt end, integerSortKind kind,
+  const std::pair<typename std::iterator_traits<RandomIt>::value_type, typename std::iterator_traits<RandomIt>::value_type>& r,
+  bool descending, size_t threads) {
+  switch (kind) {
+  case integerSortCounting: parallelCountingSort(exec, begin, end, r.first, r.second, descending, threads); break;
+  case integerSortNarrow16: parallelNarrowSort<uint16_t>(exec, begin, end, r.first, r.second, descending, threads); break;
+  case integerSortNarrow32: parallelNarrowSort<uint32_t>(exec, begin, end, r.first, r.second, descending, threads); break;
+  default: break;
+  }
+}
+
+// tryParallelIntegerSort sorts integral values without comparing them as T when integerSortPlan finds a sort for their
+// range.  It returns false, without changing the data, when there is none.  The false_type version is for the types
+// that are not integral.
+template< class E, class RandomIt>
+bool tryParallelIntegerSort(E& exec, RandomIt begin, RandomIt end, bool descending, size_t threads, std::true_type) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  std::pair<T, T> r;
+  const integerSortKind kind = integerSortPlan(exec, begin, end, threads, r);
+  if (kind == integerSortNone) return false;
+  runIntegerSort(exec, begin, end, kind, r, descending, threads);
+  return true;
+}
+
+template< class E, class RandomIt>
+bool tryParallelIntegerSort(E&, RandomIt, RandomIt, bool, size_t, std::false_type) {
+  return false;
+}
+
+// tryParallelIntegerSortCopy is tryParallelIntegerSort for parallelSortCopy.  The plan is made from the source, which
+// is only copied to d_first when an integer sort will run there.
+template< class E, class RandomIt, class OutIt>
+bool tryParallelIntegerSortCopy(E& exec, RandomIt first, RandomIt last, OutIt d_first, bool descending, size_t threads, std::true_type) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  std::pair<T, T> r;
+  const integerSortKind kind = integerSortPlan(exec, first, last, threads, r);
+  if (kind == integerSortNone) return false;
+  const size_t len = last - first;
+  parallelForRange(exec, (size_t)0, len, [&](size_t lb, size_t le) {
+    std::copy(first + lb, first + le, d_first + lb);
+    }, 4096, schedStatic, threads);
+  runIntegerSort(exec, d_first, d_first + len, kind, r, descending, threads);
+  return true;
+}
+
+template< class E, class RandomIt, class OutIt>
+bool tryParallelIntegerSortCopy(E&, RandomIt, RandomIt, OutIt, bool, size_t, std::false_type) {
+  return false;
+}
+
+// floatSortOrder is countingSortOrder for float and double: order 1 for std::less and -1 for std::greater, else 0.
+template<class T> struct isSortableFloat { static const bool value = std::is_same<T, float>::value || std::is_same<T, double>::value; };
+template<class T, class CF> struct floatSortOrder { static const int value = 0; };
+template<class T> struct floatSortOrder<T, std::less<T>> { static const int value = isSortableFloat<T>::value ? 1 : 0; };
+template<class T> struct floatSortOrder<T, std::greater<T>> { static const int value = isSortableFloat<T>::value ? -1 : 0; };
+template<class T> struct floatSortOrder<T, std::less<>> { static const int value = isSortableFloat<T>::value ? 1 : 0; };
+template<class T> struct floatSortOrder<T, std::greater<>> { static const int value = isSortableFloat<T>::value ? -1 : 0; };
+
+// floatKey maps a float or double to an unsigned key of the same width whose integer order is the IEEE 754 totalOrder
+// of the values: -NaN < -inf < ... < -0.0 < +0.0 < ... < +inf < +NaN.  Positive values get their sign bit set and
+// negative values have all of their bits flipped.  floatFromKey undoes it, NaN payloads included.
+template<class T> struct floatKeyType {};
+template<> struct floatKeyType<float> { typedef uint32_t type; };
+template<> struct floatKeyType<double> { typedef uint64_t type; };
+
+template<class T>
+inline typename floatKeyType<T>::type floatKey(T v) {
+  typedef typename floatKeyType<T>::type U;
+  const U sign = (U)1 << (sizeof(U) * 8 - 1);
+  U u;
+  memcpy(&u, &v, sizeof(U));
+  return (u & sign) ? (U)~u : (U)(u | sign);
+}
+
+template<class T>
+inline T floatFromKey(typename floatKeyType<T>::type k) {
+  typedef typename floatKeyType<T>::type U;
+  const U sign = (U)1 << (sizeof(U) * 8 - 1);
+  U u = (k & sign) ? (U)(k ^ sign) : (U)~k;
+  T v;
+  memcpy(&v, &u, sizeof(U));
+  return v;
+}
+
+// floatIsNaN tests the bits, so that it works with -ffast-math too.
+template<class T>
+inline bool floatIsNaN(T v) {
+  auto k = floatKey(v);
+  return k < floatKey(-std::numeric_limits<T>::infinity()) || k > floatKey(std::numeric_limits<T>::infinity());
+}
+
+// totalOrderLess compares floats or doubles in IEEE totalOrder.  Unlike std::less, it is a strict weak order when
+// there are NaNs, so it can be passed to any sort.  parallelFloatSort gives the same order faster.
+struct totalOrderLess {
+  template<class T>
+  bool operator()(const T& a, const T& b) const { return floatKey(a) < floatKey(b); }
+};
+
+// the order of the NaNs in parallelFloatSort.  floatTotalOrder is the IEEE 754 totalOrder, with negative NaNs first
+// and positive NaNs last, and -0.0 before +0.0.  floatNansLast puts all of the NaNs after the numbers, ascending or
+// descending, the way numpy does.
+enum floatOrder { floatTotalOrder, floatNansLast };
+
+// parallelFloatSort sorts floats or doubles through integer keys.  The values are encoded with floatKey in parallel, the
+// keys are sorted with parallelSort as unsigned integers, and the values are decoded back in parallel in the order that
+// order and descending ask for.  Since the keys are integers, NaNs cannot break the sort the way they break a sort with
+// std::less, and the bits of every value, NaN payloads and the sign of zero included, are kept.
+template< class E, class RandomIt, typename std::enable_if<isExecutor<E>::value, int>::type = 0>
+void parallelFloatSort(E& exec, RandomIt begin, RandomIt end, floatOrder order = floatTotalOrder, bool descending = false, size_t threads = 0) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  typedef typename floatKeyType<T>::type U;
+  if (threads == 0) threads = exec.concurrency();
+  const size_t len = end - begin;
+  if (len < 2) return;
+  std::vector<U> keys(len);
+  parallelForRange(exec, (size_t)0, len, [&](size_t lb, size_t le) {
+    for (size_t i = lb; i < le; i++) keys[i] = floatKey(*(begin + i));
+    }, 4096, schedStatic, threads);
+  parallelSort(exec, keys.data(), keys.data() + len, narrowLess(), threads);
+
+  // the numbers are keys[lo, hi), with the negative NaNs before them and the positive NaNs after them.
+  const size_t lo = std::lower_bound(keys.begin(), keys.end(), floatKey(-std::numeric_limits<T>::infinity())) - keys.begin();
+  const size_t hi = std::upper_bound(keys.begin(), keys.end(), floatKey(std::numeric_limits<T>::infinity())) - keys.begin();
+  const size_t numbers = hi - lo;
+  auto source = [&](size_t i) -> size_t {
+    if (order == floatTotalOrder) return descending ? len - 1 - i : i;
+    if (i < numbers) return descending ? hi - 1 - i : lo + i;
+    i -= numbers;
+    return i < len - hi ? hi + i : i - (len - hi);
+  };
+  parallelForRange(exec, (size_t)0, len, [&](size_t lb, size_t le) {
+    for (size_t i = lb; i < le; i++) *(begin + i) = floatFromKey<T>(keys[source(i)]);
+    }, 4096, schedStatic, threads);
+}
+
+// floatsHaveNaN tells whether there are any NaNs in [begin, end), with one parallel read of the data.  The test is
+// reduced as an int, since a bool would make the per-block results a std::vector<bool>.
+template< class E, class RandomIt>
+bool floatsHaveNaN(E& exec, RandomIt begin, RandomIt end, size_t threads) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  return parallelTransformReduce(exec, begin, end, 0, [](int a, int b) { return a | b; },
+    [](T v) { return floatIsNaN(v) ? 1 : 0; }, 4096, (int64_t)threads) != 0;
+}
+
+// tryParallelFloatSort is for parallelSort of floats or doubles with std::less or std::greater, which are not strict weak
+// orders when there are NaNs.  If there are any NaNs, it sorts the values with parallelFloatSort with the NaNs last and
+// returns true.  The false_type version is for the other types.
+template< class E, class RandomIt>
+bool tryParallelFloatSort(E& exec, RandomIt begin, RandomIt end, bool descending, size_t threads, std::true_type) {
+  if (end - begin < 2 || !floatsHaveNaN(exec, begin, end, threads)) return false;
+  parallelFloatSort(exec, begin, end, floatNansLast, descending, threads);
+  return true;
+}
+
+template< class E, class RandomIt>
+bool tryParallelFloatSort(E&, RandomIt, RandomIt, bool, size_t, std::false_type) {
+  return false;
+}
+
+// tryParallelFloatSortCopy is tryParallelFloatSort for parallelSortCopy.  The source is only copied to d_first when it
+// has NaNs.
+template< class E, class RandomIt, class OutIt>
+bool tryParallelFloatSortCopy(E& exec, RandomIt first, RandomIt last, OutIt d_first, bool descending, size_t threads, std::true_type) {
+  const size_t len = last - first;
+  if (len < 2 || !floatsHaveNaN(exec, first, last, threads)) return false;
+  parallelForRange(exec, (size_t)0, len, [&](size_t lb, size_t le) {
+    std::copy(first + lb, first + le, d_first + lb);
+    }, 4096, schedStatic, threads);
+  parallelFloatSort(exec, d_first, d_first + len, floatNansLast, descending, threads);
+  return true;
+}
+
+template< class E, class RandomIt, class OutIt>
+bool tryParallelFloatSortCopy(E&, RandomIt, RandomIt, OutIt, bool, size_t, std::false_type) {
+  return false;
+}
+
+// tryPackedSortIndices is the packed key path of parallelSortIndices for integral values.  It returns false when the
+// range and the index do not fit in 64 bits together.  The false_type version is for the types that are not integral.
+template< class E, class RandomIt>
+bool tryPackedSortIndices(E& exec, RandomIt begin, RandomIt end, std::vector<size_t>& indices, bool descending, size_t threads, std::true_type) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  const size_t len = end - begin;
+  std::pair<T, T> r = parallelMinMax(exec, begin, end, threads);
+  const uint64_t span = (uint64_t)r.second - (uint64_t)r.first;
+  unsigned keyBits = 0, indexBits = 0;
+  while (keyBits < 64 && (span >> keyBits) != 0) keyBits++;
+  while (indexBits < 64 && ((uint64_t)(len - 1) >> indexBits) != 0) indexBits++;
+  if (keyBits + indexBits > 64) return false;
+  const T minV = r.first, maxV = r.second;
+  std::vector<uint64_t> packed(len);
+  parallelForRange(exec, (size_t)0, len, [&](size_t lb, size_t le) {
+    for (size_t i = lb; i < le; i++) {
+      uint64_t key = descending ? (uint64_t)maxV - (uint64_t)*(begin + i) : (uint64_t)*(begin + i) - (uint64_t)minV;
+      packed[i] = indexBits == 64 ? i : (key << indexBits) | i;
     }
-    else { // else do a merge using the forward-forward merge
-      mergeFF(dst, src, a0, a1 - 1, b0, b1 - 1, wtid, compFunc);
+    }, 4096, schedStatic, threads);
+  parallelSort(exec, packed.data(), packed.data() + len, narrowLess(), threads);
+  const uint64_t mask = indexBits == 64 ? ~0ull : (((uint64_t)1 << indexBits) - 1);
+  parallelForRange(exec, (size_t)0, len, [&](size_t lb, size_t le) {
+    for (size_t i = lb; i < le; i++) indices[i] = (size_t)(packed[i] & mask);
+    }, 4096, schedStatic, threads);
+  return true;
+}
+
+template< class E, class RandomIt>
+bool tryPackedSortIndices(E&, RandomIt, RandomIt, std::vector<size_t>&, bool, size_t, std::false_type) {
+  return false;
+}
+
+// parallelSortIndices sets indices to the positions of [begin, end) in sorted order, so that begin[indices[0]],
+// begin[indices[1]], ... is sorted and positions of equal values are in increasing order.  The data is not changed.
+// For integral values with std::less or std::greater whose range and index fit together in 64 bits, each value is
+// encoded as a key with its position packed into the low bits, and the packed keys are sorted with parallelSort.
+// Otherwise the positions are sorted with parallelStableSort, comparing the values they point to.
+template< class E, class RandomIt, class CF, typename std::enable_if<isExecutor<E>::value, int>::type = 0>
+void parallelSortIndices(E& exec, RandomIt begin, RandomIt end, std::vector<size_t>& indices, CF compFunc, size_t threads = 0) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  if (threads == 0) threads = exec.concurrency();
+  const size_t len = end - begin;
+  indices.resize(len);
+  if (len == 0) return;
+  if (countingSortOrder<T, CF>::value != 0 && tryPackedSortIndices(exec, begin, end, indices, countingSortOrder<T, CF>::value < 0, threads,
+    std::integral_constant<bool, countingSortOrder<T, CF>::value != 0>())) return;
+  parallelForRange(exec, (size_t)0, len, [&](size_t lb, size_t le) {
+    for (size_t i = lb; i < le; i++) indices[i] = i;
+    }, 4096, schedStatic, threads);
+  parallelStableSort(exec, indices.begin(), indices.end(), [begin, compFunc](size_t a, size_t b) {
+    return compFunc(*(begin + a), *(begin + b));
+    }, threads);
+}
+
+// parallelCountingSortBy sorts records by an integral key, key(record), with a stable counting sort.  It is for keys with
+// a small range, such as a status code or a shard id, with any record type.  Each thread counts the keys of its part of
+// the range, a scan of the counts in key-major order gives each thread where to write each key, and the records are
+// scattered in order to a buffer and copied back.  It returns false, without changing the data, when the range of
+// keys is too large for a counting sort.
+template< class E, class RandomIt, class KeyFn, typename std::enable_if<isExecutor<E>::value, int>::type = 0>
+bool parallelCountingSortBy(E& exec, RandomIt begin, RandomIt end, KeyFn keyFn, size_t threads = 0) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  typedef typename std::decay<decltype(keyFn(*begin))>::type K;
+  static_assert(countingSortable<K>::value, "parallelCountingSortBy needs an integral key of 64 bits or less");
+  if (threads == 0) threads = exec.concurrency();
+  const size_t len = end - begin;
+  if (len < 2) return true;
+  threads = maximum(minimum(threads, len / 4096), 1);
+
+  typedef std::pair<K, K> keyRange;
+  K first = keyFn(*begin);
+  keyRange r = parallelTransformReduce(exec, begin, end, keyRange(first, first),
+    [](const keyRange& a, const keyRange& b) { return keyRange(minimum(a.first, b.first), maximum(a.second, b.second)); },
+    [&keyFn](const T& v) { K k = keyFn(v); return keyRange(k, k); }, 4096, (int64_t)threads);
+  const uint64_t span = (uint64_t)r.second - (uint64_t)r.first;
+  if (span >= ((uint64_t)1 << 20)) return false;
+  const uint64_t range = span + 1;
+  if (range * threads > maximum(len, (size_t)1 << 16)) return false;
+
+  const double delta = double(len) / double(threads);
+  auto bound = [len, delta, threads](size_t t) { return t >= threads ? len : (size_t)llround(double(t) * delta); };
+  const K minK = r.first;
+  std::vector<size_t> counts(range * threads, 0);
+  parallelFor(exec, (int64_t)0, (int64_t)threads, [&](int64_t t) {
+    for (size_t i = bound(t); i < bound(t + 1); i++) counts[((uint64_t)keyFn(*(begin + i)) - (uint64_t)minK) * threads + t]++;
+    }, threads);
+  parallelExclusiveScan(exec, counts.begin(), counts.end(), counts.begin(), (size_t)0, std::plus<size_t>(), 4096, threads);
+
+  std::vector<T> buffer(len);
+  parallelFor(exec, (int64_t)0, (int64_t)threads, [&](int64_t t) {
+    for (size_t i = bound(t); i < bound(t + 1); i++) {
+      size_t& pos = counts[((uint64_t)keyFn(*(begin + i)) - (uint64_t)minK) * threads + t];
+      buffer[pos++] = std::move(*(begin + i));
     }
     }, threads);
+  parallelForRange(exec, (size_t)0, len, [&](size_t lb, size_t le) {
+    std::move(buffer.begin() + lb, buffer.begin() + le, begin + lb);
+    }, 4096, schedStatic, threads);
+  return true;
+}
+
+template< class RandomIt, class KeyFn>
+bool parallelCountingSortBy(RandomIt begin, RandomIt end, KeyFn keyFn, size_t threads = 0) {
+  return parallelCountingSortBy(defaultExecutor(), begin, end, keyFn, threads);
 }
 
 // this function is only for debug purposes.
@@ -150,6 +904,9 @@ void print(std::string t, T* in, int n) {
 template< class RandomIt, class CF>
 void parallelSort(RandomIt begin, RandomIt end, CF compFunc, size_t threads = 0) {
   // default number of threads iw the hardware number of cores.
+  // the default is governed: the threads are drawn from the process wide concurrencyGovernor
+  // so that many simultaneous calls share the cores instead of oversubscribing them.
+  const bool governed = threads == 0;
   if (threads == 0) threads = std::thread::hardware_concurrency();
   // Get the total size;
   const size_t len = end - begin;
@@ -159,6 +916,11 @@ void parallelSort(RandomIt begin, RandomIt end, CF compFunc, size_t threads = 0)
   size_t max_threads = (len + 64) / 128LL;
   max_threads = maximum(max_threads, 1);
   threads = minimum(threads, max_threads);
+  std::unique_ptr<governedThreads> grant;
+  if (governed && threads > 1) {
+    grant.reset(new governedThreads(threads));
+    threads = grant->threads();
+  }
 
   // calculate the fractional size of each segment to sort.
   // calculating the array segments using doubles results in segment sizes where the max segment size
@@ -233,10 +995,14 @@ void parallelSort(RandomIt begin, RandomIt end, CF compFunc, size_t threads = 0)
 
 //#pragma message ("Compiling MINIMIZED_THREAD_LAUNCH mode")
 
-template< class RandomIt, class CF>
-void parallelSort(RandomIt begin, RandomIt end, CF compFunc, size_t threads = 0) {
-  // default number of threads iw the hardware number of cores.
-  if (threads == 0) threads = std::thread::hardware_concurrency();
+// parallelSort runs its segment sorts and merges on exec.
+template< class E, class RandomIt, class CF, typename std::enable_if<isExecutor<E>::value, int>::type = 0>
+void parallelSort(E& exec, RandomIt begin, RandomIt end, CF compFunc, size_t threads = 0) {
+  // default number of threads iw the concurrency of the executor, the hardware number of cores for the default executor.
+  // the default is governed: the threads are drawn from the process wide concurrencyGovernor
+  // so that many simultaneous calls share the cores instead of oversubscribing them.
+  const bool governed = threads == 0;
+  if (threads == 0) threads = exec.concurrency();
   // Get the total size;
   const size_t len = end - begin;
 
@@ -245,6 +1011,21 @@ void parallelSort(RandomIt begin, RandomIt end, CF compFunc, size_t threads = 0)
   size_t max_threads = (len + 64) / 128LL;
   max_threads = maximum(max_threads, 1);
   threads = minimum(threads, max_threads);
+  std::unique_ptr<governedThreads> grant;
+  if (governed && threads > 1) {
+    grant.reset(new governedThreads(threads));
+    threads = grant->threads();
+  }
+  // integers with a small range of values are counted instead of sorted, and those with a range that fits a
+  // narrower type are sorted as narrow keys.
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  if (countingSortOrder<T, CF>::value != 0 && tryParallelIntegerSort(exec, begin, end, countingSortOrder<T, CF>::value < 0, threads,
+    std::integral_constant<bool, countingSortOrder<T, CF>::value != 0>())) return;
+  // floats and doubles with NaNs are sorted as integer keys.
+  if (floatSortOrder<T, CF>::value != 0 && tryParallelFloatSort(exec, begin, end, floatSortOrder<T, CF>::value < 0, threads,
+    std::integral_constant<bool, floatSortOrder<T, CF>::value != 0>())) return;
+  // background sorts pass their merges through a mergeGate.
+  mergeGate* gate = currentMergeGate();
 
   // calculate the fractional size of each segment to sort.
   // calculating the array segments using doubles results in segment sizes where the max segment size
@@ -252,11 +1033,9 @@ void parallelSort(RandomIt begin, RandomIt end, CF compFunc, size_t threads = 0)
   double delta = double(len) / double(threads);
 
   //sort threads segments of the input arry using the sort method provided in the function pointer
-  parallelFor((int64_t)0, (int64_t)threads, [begin, delta, compFunc](int64_t i) {
-    int64_t lb = llround(i * delta);
-    int64_t le = llround((i + 1) * delta);
-    std::sort(begin + lb, begin + le, compFunc);
-    }, threads);
+  parallelForRange(exec, begin, end, [compFunc](RandomIt lb, RandomIt le) {
+    std::sort(lb, le, compFunc);
+    }, 1, schedStatic, threads);
 
   if (threads <= 1) return;
 
@@ -267,76 +1046,426 @@ void parallelSort(RandomIt begin, RandomIt end, CF compFunc, size_t threads = 0)
   T* swap;  // pointer to array that that the data will be swapped to during a merge function
   swap = new typename std::iterator_traits<RandomIt>::value_type[len];
 
+  // Each level merges pairs of adjacent runs of segments.  The threads are split between the merges of a level
+  // with splitThreads, in proportion to their sizes, so the shares add up to exactly threads.  Every merge is one
+  // outer task that runs one of its share's partitions itself, so a level never has more than threads workers,
+  // including the calling thread.  The number of levels is made even so that the result ends up back in begin;
+  // when the depth is odd the last level is a copy of the single run out of swap.
   const int64_t depth = (int64_t)ceil(log2(threads)); // calculate the number of depth iterations
-
-  int64_t loops; // number of full size (2*delta) segment merges that need to be run
-  int64_t tasks; // number of parallel tasks tht need to be run (loops + leftover is any)
-  int64_t pmThreads; // number of threads to apply to full size parallelMerges (inside the parallel loop)
-  int64_t loThreads; // number of threads to apply to leftover parallel_merge.
-  double loStart;  // the starting point if the left overs
+  auto bound = [len, delta, threads](size_t seg) { return seg >= threads ? len : (size_t)llround(double(seg) * delta); };
+  auto mergeLevel = [&](auto dst, auto src, size_t width) {
+    const size_t merges = iDivUp(threads, 2 * width);
+    std::vector<size_t> sizes(merges);
+    for (size_t m = 0; m < merges; m++) sizes[m] = bound((2 * m + 2) * width) - bound(2 * m * width);
+    std::vector<size_t> shares = splitThreads(threads, sizes);
+    parallelFor(exec, (int64_t)0, (int64_t)merges, [&](int64_t m) {
+      size_t lb = bound(2 * m * width), lm = bound((2 * m + 1) * width), le = bound((2 * m + 2) * width);
+      if (lm >= le) lm = le;   // a run with no partner is copied to the next level
+      parallelMerge(exec, dst, src, lb, lm - 1, lm, le - 1, lb, compFunc, shares[m], gate);
+      }, merges);
+  };
+  size_t width = 1;
   for (int64_t d = depth; d > 0; d -= 2) {
-    // This section computes teh number of tasks that need to be performed and how many threads to 
-    // give to each task.  After the above sort, there are <threads> number of segments that need 
-    // to be iteratively merged.  Each segment is initially delta large.  The first set of tasks is 
-    // to merge two adjacent segments that are exactly delta each.  The variable loops the number
-    // of these that need to be processed. is  However there are cases where 
-    // this does not cover all the segments, i.e. the case of an odd number of segments.  In such cases,
-    // the "left over" segments need to be handled outside the main loop and adds one more task to be handled
-    // pmThreads is the number of threads given to each parallelMerge in the full delta sized segments
-    // loThreads is the number of threads assigned to the left over parallelMerge and will be 0
-    // if there is no left over or = to or 1 less than pmThreads.
-    loops = (int64_t)floor(double(len) / (2.0 * delta));
-    loStart = double(loops) * 2.0 * delta;
-    tasks = loops + ((llround(loStart) < (int64_t)len) ? 1 : 0);
-    pmThreads = iDivUp(threads, tasks);
-    loThreads = threads - (loops * pmThreads);
-    // merged the full sized pairs of of segments for this level.
-    auto futures = parallelForNoWait((int64_t)0, loops, [&](int64_t i) {
-      int64_t lb = llround(double(2 * i) * delta);
-      int64_t lm = llround(double(2 * i + 1) * delta);
-      int64_t le = llround(double(2 * i + 2) * delta);
-      parallelMerge(swap, begin, lb, lm - 1, lm, le - 1, lb, compFunc, pmThreads);
-      }, loops);
-    // if there is an odd number segments to be merged, take care of the left overs.
-    if (llround(loStart) < (int64_t)len) {
-      int64_t mid = llround(loStart + delta);
-      if (mid > (int64_t)len) mid = len;   // do a merge if there is a segment plus a partial segment
-      parallelMerge(swap, begin, llround(loStart), mid - 1, mid, len - 1, llround(loStart), compFunc, loThreads);
-    }
-    parallelForFinish(futures);
-    delta *= 2.0;
-
-    loops = (int64_t)floor(double(len) / (2.0 * delta));
-    loStart = double(loops) * 2.0 * delta;
-    tasks = loops + ((llround(loStart) < (int64_t)len) ? 1 : 0);
-    pmThreads = iDivUp(threads, tasks);
-    loThreads = threads - (loops * pmThreads);
-    // merged the full sized pairs of of segments for this level.
-    //for (int64_t i = 0; i < loops; i++) {
-    futures = parallelForNoWait((int64_t)0, loops, [&](int64_t i) {
-      int64_t lb = llround(double(2 * i) * delta);
-      int64_t lm = llround(double(2 * i + 1) * delta);
-      int64_t le = llround(double(2 * i + 2) * delta);
-      parallelMerge(begin, swap, lb, lm - 1, lm, le - 1, lb, compFunc, pmThreads);
-      }, loops);
-    // if there is an odd number segments to be merged, take care of the left overs.
-    if (llround(loStart) < (int64_t)len) {
-      int64_t mid = llround(loStart + delta);
-      if (mid > (int64_t)len) mid = len;   // do a merge if there is a segment plus a partial segment
-      parallelMerge(begin, swap, llround(loStart), mid - 1, mid, len - 1, llround(loStart), compFunc, loThreads);
-    }
-    parallelForFinish(futures);
-    delta *= 2.0;  // double the size of delta for the level of merges
+    mergeLevel(swap, begin, width);
+    width *= 2;
+    mergeLevel(begin, swap, width);
+    width *= 2;
   }
   // clean up
   delete[] swap;
 
 }
+
+template< class RandomIt, class CF>
+void parallelSort(RandomIt begin, RandomIt end, CF compFunc, size_t threads = 0) {
+  parallelSort(defaultExecutor(), begin, end, compFunc, threads);
+}
 #endif // !BALANCED_MULTITHREADING
 
+// parallelSortBackground sorts like parallelSort but at low priority for maintenance work that shares the
+// machine with latency sensitive work.  The sort runs on its own thread with the priority in setting, and every
+// thread it starts inherits it.  A merge yields the core after each partition, and if maxMergeTasks is not 0, at
+// most that many merge partitions run at once to cap the memory bandwidth the sort uses.
+template< class RandomIt, class CF>
+void parallelSortBackground(RandomIt begin, RandomIt end, CF compFunc, size_t threads = 0, size_t maxMergeTasks = 0,
+  threadPrioritySetting setting = threadPrioritySetting()) {
+  setting.background = true;
+  mergeGate gate((int64_t)maxMergeTasks, true);
+  std::thread sorter([&]() {
+    scopedThreadPriority priority(setting);
+    currentMergeGate() = &gate;
+    parallelSort(begin, end, compFunc, threads);
+    currentMergeGate() = nullptr;
+    });
+  sorter.join();
+}
+
 template< class RandomIt>
 void parallelSort(RandomIt begin, RandomIt end, size_t threads = 0) {
   parallelSort(begin, end, std::less<typename std::iterator_traits<RandomIt>::value_type>(), threads);
 }
 
+template< class E, class RandomIt, typename std::enable_if<isExecutor<E>::value, int>::type = 0>
+void parallelSort(E& exec, RandomIt begin, RandomIt end, size_t threads = 0) {
+  parallelSort(exec, begin, end, std::less<typename std::iterator_traits<RandomIt>::value_type>(), threads);
+}
+
+// parallelSortCopy writes the values of [first, last) to d_first in sorted order and leaves the input as it is, like a
+// copy followed by parallelSort without the separate copy pass.  Each thread copies its segment of the input to where
+// the segment is sorted, and the merge levels then go back and forth between d_first and a scratch buffer.  The
+// segments are sorted in the scratch buffer when the number of merge levels is odd, so the last level lands in
+// d_first and, unlike parallelSort, no level is spent copying the result back.  When parallelSort would sort the values
+// without merges, as integers with a small range or floats with NaNs, which is decided from the source, the source is
+// copied to d_first and sorted there that way.
+template< class E, class RandomIt, class OutIt, class CF, typename std::enable_if<isExecutor<E>::value, int>::type = 0>
+void parallelSortCopy(E& exec, RandomIt first, RandomIt last, OutIt d_first, CF compFunc, size_t threads = 0) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  // the default is governed like parallelSort.
+  const bool governed = threads == 0;
+  if (threads == 0) threads = exec.concurrency();
+  const size_t len = last - first;
+
+  // limit the number of threads so that there are at least 128 values / thread.
+  size_t max_threads = (len + 64) / 128LL;
+  max_threads = maximum(max_threads, 1);
+  threads = minimum(threads, max_threads);
+  std::unique_ptr<governedThreads> grant;
+  if (governed && threads > 1) {
+    grant.reset(new governedThreads(threads));
+    threads = grant->threads();
+  }
+  // integers whose range allows it, and floats with NaNs, are copied and sorted in d_first as parallelSort sorts them.
+  if (countingSortOrder<T, CF>::value != 0 && tryParallelIntegerSortCopy(exec, first, last, d_first, countingSortOrder<T, CF>::value < 0,
+    threads, std::integral_constant<bool, countingSortOrder<T, CF>::value != 0>())) return;
+  if (floatSortOrder<T, CF>::value != 0 && tryParallelFloatSortCopy(exec, first, last, d_first, floatSortOrder<T, CF>::value < 0,
+    threads, std::integral_constant<bool, floatSortOrder<T, CF>::value != 0>())) return;
+  if (threads <= 1) {
+    std::copy(first, last, d_first);
+    std::sort(d_first, d_first + len, compFunc);
+    return;
+  }
+  mergeGate* gate = currentMergeGate();
+
+  double delta = double(len) / double(threads);
+  auto bound = [len, delta, threads](size_t seg) { return seg >= threads ? len : (size_t)llround(double(seg) * delta); };
+  const int64_t depth = (int64_t)ceil(log2(threads)); // calculate the number of depth iterations
+  std::vector<T> scratch(len);
+  T* swap = scratch.data();
+
+  // sort each segment where it has to be for the last merge level to write to d_first.
+  const bool inSwap = depth % 2 == 1;
+  parallelFor(exec, (int64_t)0, (int64_t)threads, [&](int64_t t) {
+    const size_t lb = bound(t), le = bound(t + 1);
+    if (inSwap) {
+      std::copy(first + lb, first + le, swap + lb);
+      std::sort(swap + lb, swap + le, compFunc);
+    }
+    else {
+      std::copy(first + lb, first + le, d_first + lb);
+      std::sort(d_first + lb, d_first + le, compFunc);
+    }
+    }, threads);
+
+  auto mergeLevel = [&](auto dst, auto src, size_t width) {
+    const size_t merges = iDivUp(threads, 2 * width);
+    std::vector<size_t> sizes(merges);
+    for (size_t m = 0; m < merges; m++) sizes[m] = bound((2 * m + 2) * width) - bound(2 * m * width);
+    std::vector<size_t> shares = splitThreads(threads, sizes);
+    parallelFor(exec, (int64_t)0, (int64_t)merges, [&](int64_t m) {
+      size_t lb = bound(2 * m * width), lm = bound((2 * m + 1) * width), le = bound((2 * m + 2) * width);
+      if (lm >= le) lm = le;   // a run with no partner is copied to the next level
+      parallelMerge(exec, dst, src, lb, lm - 1, lm, le - 1, lb, compFunc, shares[m], gate);
+      }, merges);
+  };
+  size_t width = 1;
+  for (int64_t d = depth; d > 0; d--, width *= 2) {
+    if (d % 2 == 1) mergeLevel(d_first, swap, width);
+    else mergeLevel(swap, d_first, width);
+  }
+}
+
+template< class RandomIt, class OutIt, class CF>
+void parallelSortCopy(RandomIt first, RandomIt last, OutIt d_first, CF compFunc, size_t threads = 0) {
+  parallelSortCopy(defaultExecutor(), first, last, d_first, compFunc, threads);
+}
+
+template< class RandomIt, class OutIt>
+void parallelSortCopy(RandomIt first, RandomIt last, OutIt d_first, size_t threads = 0) {
+  parallelSortCopy(first, last, d_first, std::less<typename std::iterator_traits<RandomIt>::value_type>(), threads);
+}
+
+// parallelStableSort sorts like parallelSort but keeps equal elements in their original order, like std::stable_sort.
+// The segments are sorted with std::stable_sort and then merged level by level with parallelMergeStable.
+// In each level every pair of adjacent runs is merged with a share of the threads from splitThreads.
+template< class E, class RandomIt, class CF, typename std::enable_if<isExecutor<E>::value, int>::type = 0>
+void parallelStableSort(E& exec, RandomIt begin, RandomIt end, CF compFunc, size_t threads = 0) {
+  if (threads == 0) threads = exec.concurrency();
+  const size_t len = end - begin;
+
+  // limit the number of threads so that there are at least 128 values / thread.
+  size_t max_threads = (len + 64) / 128LL;
+  max_threads = maximum(max_threads, 1);
+  threads = minimum(threads, max_threads);
+  double delta = double(len) / double(threads);
+  auto bound = [len, delta, threads](size_t seg) { return seg >= threads ? len : (size_t)llround(double(seg) * delta); };
+
+  parallelForRange(exec, begin, end, [compFunc](RandomIt lb, RandomIt le) {
+    std::stable_sort(lb, le, compFunc);
+    }, 1, schedStatic, threads);
+
+  if (threads <= 1) return;
+
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  std::vector<T> swap(len);
+  bool inSwap = false;
+  for (size_t width = 1; width < threads; width *= 2) {
+    const int64_t pairs = (int64_t)iDivUp(threads, 2 * width);
+    std::vector<size_t> sizes(pairs);
+    for (int64_t p = 0; p < pairs; p++) sizes[p] = bound((2 * p + 2) * width) - bound(2 * p * width);
+    std::vector<size_t> shares = splitThreads(threads, sizes);
+    auto mergeLevel = [&](auto dst, auto src) {
+      parallelFor(exec, (int64_t)0, pairs, [&](int64_t p) {
+        size_t lb = bound(2 * p * width), lm = bound((2 * p + 1) * width), le = bound((2 * p + 2) * width);
+        if (lm >= le) {  // an odd run at the end is just copied to the next level
+          std::copy(src + lb, src + le, dst + lb);
+          return;
+        }
+        parallelMergeStable(exec, dst, src, lb, lm - 1, lm, le - 1, lb, compFunc, shares[p]);
+        }, pairs);
+    };
+    if (inSwap) mergeLevel(begin, swap.data());
+    else mergeLevel(swap.data(), begin);
+    inSwap = !inSwap;
+  }
+  if (inSwap) {
+    T* src = swap.data();
+    parallelForRange(exec, (size_t)0, len, [begin, src](size_t lb, size_t le) {
+      std::copy(src + lb, src + le, begin + lb);
+      }, 1, schedStatic, threads);
+  }
+}
+
+template< class RandomIt, class CF>
+void parallelStableSort(RandomIt begin, RandomIt end, CF compFunc, size_t threads = 0) {
+  parallelStableSort(defaultExecutor(), begin, end, compFunc, threads);
+}
+
+template< class RandomIt>
+void parallelStableSort(RandomIt begin, RandomIt end, size_t threads = 0) {
+  parallelStableSort(begin, end, std::less<typename std::iterator_traits<RandomIt>::value_type>(), threads);
+}
+
+// parallelSortWeighted sorts like parallelSort, for values whose cost to compare and copy varies widely, such as strings
+// from 3 to 3000 bytes.  weightFn(value) is the cost of a value beyond the cost of any value, such as the length of a
+// string.  The segments are cut at equal sums of the weights of the input, and each level of merges splits the
+// threads between its merges, and each merge between its threads, by the sums of the weights from a prefix sum of the
+// weights of the level's input.  The sorts and the merges then take about the same time on every thread, where
+// with equal counts the thread that gets the long strings would finish last.
+template< class E, class RandomIt, class CF, class WeightFn, typename std::enable_if<isExecutor<E>::value, int>::type = 0>
+void parallelSortWeighted(E& exec, RandomIt begin, RandomIt end, CF compFunc, WeightFn weightFn, size_t threads = 0) {
+  if (threads == 0) threads = exec.concurrency();
+  const size_t len = end - begin;
+
+  // limit the number of threads so that there are at least 128 values / thread.
+  size_t max_threads = (len + 64) / 128LL;
+  max_threads = maximum(max_threads, 1);
+  threads = minimum(threads, max_threads);
+  if (threads <= 1) {
+    std::sort(begin, end, compFunc);
+    return;
+  }
+
+  // prefix[i] is the weight of the values before i, with every value weighing one more than weightFn, so that a
+  // weight of 0 still counts as an element.
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  std::vector<uint64_t> prefix(len + 1);
+  auto prefixSums = [&](auto src) {
+    parallelForRange(exec, (size_t)0, len, [&](size_t lb, size_t le) {
+      for (size_t i = lb; i < le; i++) prefix[i] = (uint64_t)weightFn(*(src + i)) + 1;
+      }, 4096, schedStatic, threads);
+    prefix[len] = 0;
+    parallelExclusiveScan(exec, prefix.begin(), prefix.end(), prefix.begin(), (uint64_t)0, std::plus<uint64_t>(), 4096, threads);
+  };
+  prefixSums(begin);
+  const uint64_t total = prefix[len];
+  std::vector<size_t> bounds(threads + 1);
+  for (size_t t = 0; t <= threads; t++) {
+    uint64_t target = (uint64_t)llround(double(total) * double(t) / double(threads));
+    bounds[t] = std::lower_bound(prefix.begin(), prefix.end(), target) - prefix.begin();
+  }
+  bounds[threads] = len;
+  auto bound = [&bounds, threads](size_t seg) { return bounds[minimum(seg, threads)]; };
+
+  parallelFor(exec, (int64_t)0, (int64_t)threads, [&](int64_t t) {
+    std::sort(begin + bound(t), begin + bound(t + 1), compFunc);
+    }, threads);
+
+  std::vector<T> swap(len);
+  bool inSwap = false;
+  for (size_t width = 1; width < threads; width *= 2) {
+    const int64_t pairs = (int64_t)iDivUp(threads, 2 * width);
+    std::vector<size_t> sizes(pairs);
+    auto mergeLevel = [&](auto dst, auto src) {
+      prefixSums(src);  // the sorts and merges moved the values, so the prefix sums are taken again for each level
+      for (int64_t p = 0; p < pairs; p++) sizes[p] = (size_t)(prefix[bound((2 * p + 2) * width)] - prefix[bound(2 * p * width)]);
+      std::vector<size_t> shares = splitThreads(threads, sizes);
+      parallelFor(exec, (int64_t)0, pairs, [&](int64_t p) {
+        size_t lb = bound(2 * p * width), lm = bound((2 * p + 1) * width), le = bound((2 * p + 2) * width);
+        if (lm >= le) {  // an odd run at the end is just copied to the next level
+          std::move(src + lb, src + le, dst + lb);
+          return;
+        }
+        parallelMergeWeighted(exec, dst, src, lb, lm - 1, lm, le - 1, lb, compFunc, prefix.data(), shares[p]);
+        }, pairs);
+    };
+    if (inSwap) mergeLevel(begin, swap.data());
+    else mergeLevel(swap.data(), begin);
+    inSwap = !inSwap;
+  }
+  if (inSwap) {
+    T* src = swap.data();
+    parallelForRange(exec, (size_t)0, len, [begin, src](size_t lb, size_t le) {
+      std::move(src + lb, src + le, begin + lb);
+      }, 1, schedStatic, threads);
+  }
+}
+
+template< class RandomIt, class CF, class WeightFn>
+void parallelSortWeighted(RandomIt begin, RandomIt end, CF compFunc, WeightFn weightFn, size_t threads = 0) {
+  parallelSortWeighted(defaultExecutor(), begin, end, compFunc, weightFn, threads);
+}
+
+// insertionSort sorts [begin, end) in place.  It is faster than std::sort for a few tens of elements or fewer.
+template< class RandomIt, class CF>
+void insertionSort(RandomIt begin, RandomIt end, CF compFunc) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  if (end - begin < 2) return;
+  for (RandomIt i = begin + 1; i != end; ++i) {
+    T v = std::move(*i);
+    RandomIt j = i;
+    for (; j != begin && compFunc(v, *(j - 1)); --j) *j = std::move(*(j - 1));
+    *j = std::move(v);
+  }
+}
+
+// parallelSegmentedSort sorts each segment [data + offsets[s], data + offsets[s + 1]) of data independently,
+// as for the rows of a CSR matrix.  offsets holds the segment count + 1 boundaries and supports size() and [].
+// The segments are put in bins by size.  A segment with more than its threads' share of the total
+// n log n work is sorted with parallelSort on all threads, one after another.  The rest are split into
+// threads runs of consecutive segments with about equal work, and each run is sorted on one thread with
+// insertionSort for segments of up to 16 elements and std::sort for longer ones.
+template< class E, class RandomIt, class Offsets, class CF, typename std::enable_if<isExecutor<E>::value, int>::type = 0>
+void parallelSegmentedSort(E& exec, RandomIt data, const Offsets& offsets, CF compFunc, size_t threads = 0) {
+  if (threads == 0) threads = exec.concurrency();
+  if (offsets.size() < 2) return;
+  const size_t segments = offsets.size() - 1;
+  auto work = [](size_t n) { return n < 2 ? 0.0 : double(n) * std::log2(double(n)); };
+
+  // the work of each segment, computed in parallel since there may be millions of segments.
+  std::vector<double> segWork(segments);
+  parallelForRange(exec, (size_t)0, segments, [&](size_t lb, size_t le) {
+    for (size_t s = lb; s < le; s++) segWork[s] = work((size_t)(offsets[s + 1] - offsets[s]));
+    }, 4096, schedStatic, threads);
+  const double totalWork = parallelReduce(exec, segWork.begin(), segWork.end(), 0.0, std::plus<double>(), 4096, threads);
+  if (totalWork == 0.0) return;
+
+  // large segments get all of the threads in turn, and count as no work in the runs below.
+  std::vector<size_t> large;
+  const double share = totalWork / double(threads);
+  for (size_t s = 0; s < segments; s++) {
+    if (threads > 1 && segWork[s] > share && offsets[s + 1] - offsets[s] >= 4096) {
+      large.push_back(s);
+      segWork[s] = 0.0;
+    }
+  }
+  for (size_t s : large) parallelSort(exec, data + offsets[s], data + offsets[s + 1], compFunc, threads);
+
+  // the rest are cut into runs of consecutive segments with about equal work, found by a binary search of the
+  // prefix sums of the work.
+  parallelInclusiveScan(exec, segWork.begin(), segWork.end(), segWork.begin(), std::plus<double>(), 4096, threads);
+  const double runWork = segWork.back() / double(threads);
+  std::vector<size_t> runStart(1, 0);
+  for (size_t r = 1; r < threads && runWork > 0.0; r++) {
+    size_t s = std::lower_bound(segWork.begin(), segWork.end(), runWork * double(r)) - segWork.begin() + 1;
+    if (s > runStart.back() && s < segments) runStart.push_back(s);
+  }
+  runStart.push_back(segments);
+  const int64_t runs = (int64_t)runStart.size() - 1;
+
+  parallelFor(exec, (int64_t)0, runs, [&](int64_t r) {
+    for (size_t s = runStart[r]; s < runStart[r + 1]; s++) {
+      size_t n = (size_t)(offsets[s + 1] - offsets[s]);
+      if (std::binary_search(large.begin(), large.end(), s)) continue;
+      if (n <= 16) insertionSort(data + offsets[s], data + offsets[s + 1], compFunc);
+      else std::sort(data + offsets[s], data + offsets[s + 1], compFunc);
+    }
+    }, runs);
+}
+
+// parallelSortGroups sorts each group of N consecutive elements of [data, data + groups * N) with sortFixed, with the
+// groups split evenly between the threads.  It is for many tiny groups of a size known at compile time, which
+// parallelSegmentedSort would sort one std::sort or insertionSort call at a time.
+template< size_t N, class E, class RandomIt, class CF, typename std::enable_if<isExecutor<E>::value, int>::type = 0>
+void parallelSortGroups(E& exec, RandomIt data, size_t groups, CF compFunc, size_t threads = 0) {
+  parallelForRange(exec, (size_t)0, groups, [&](size_t lb, size_t le) {
+    for (size_t g = lb; g < le; g++) sortFixed<N>(&*(data + g * N), compFunc);
+    }, 1024, schedStatic, threads);
+}
+
+// arrays of up to sortFixedMax elements are sorted with sortFixed on the calling thread, and larger ones with parallelSort.
+template< class T, size_t N, class CF>
+void sortArray(std::array<T, N>& a, CF compFunc, size_t, std::true_type) {
+  sortFixed<N>(a.data(), compFunc);
+}
+
+template< class T, size_t N, class CF>
+void sortArray(std::array<T, N>& a, CF compFunc, size_t threads, std::false_type) {
+  parallelSort(a.begin(), a.end(), compFunc, threads);
+}
+
+template< class T, size_t N, class CF>
+void parallelSort(std::array<T, N>& a, CF compFunc, size_t threads = 0) {
+  sortArray(a, compFunc, threads, std::integral_constant<bool, N <= sortFixedMax>());
+}
+
+template< class T, size_t N>
+void parallelSort(std::array<T, N>& a, size_t threads = 0) {
+  parallelSort(a, std::less<T>(), threads);
+}
+
+template< class RandomIt, class Offsets, class CF>
+void parallelSegmentedSort(RandomIt data, const Offsets& offsets, CF compFunc, size_t threads = 0) {
+  parallelSegmentedSort(defaultExecutor(), data, offsets, compFunc, threads);
+}
+
+template< class RandomIt, class Offsets>
+void parallelSegmentedSort(RandomIt data, const Offsets& offsets, size_t threads = 0) {
+  parallelSegmentedSort(data, offsets, std::less<typename std::iterator_traits<RandomIt>::value_type>(), threads);
+}
+
+template< class RandomIt, class CF>
+void parallelSortIndices(RandomIt begin, RandomIt end, std::vector<size_t>& indices, CF compFunc, size_t threads = 0) {
+  parallelSortIndices(defaultExecutor(), begin, end, indices, compFunc, threads);
+}
+
+template< class RandomIt>
+void parallelSortIndices(RandomIt begin, RandomIt end, std::vector<size_t>& indices, size_t threads = 0) {
+  parallelSortIndices(begin, end, indices, std::less<typename std::iterator_traits<RandomIt>::value_type>(), threads);
+}
+
+template< class RandomIt>
+void parallelFloatSort(RandomIt begin, RandomIt end, floatOrder order = floatTotalOrder, bool descending = false, size_t threads = 0) {
+  parallelFloatSort(defaultExecutor(), begin, end, order, descending, threads);
+}
+
+template< size_t N, class RandomIt, class CF>
+void parallelSortGroups(RandomIt data, size_t groups, CF compFunc, size_t threads = 0) {
+  parallelSortGroups<N>(defaultExecutor(), data, groups, compFunc, threads);
+}
+
+template< size_t N, class RandomIt>
+void parallelSortGroups(RandomIt data, size_t groups, size_t threads = 0) {
+  parallelSortGroups<N>(data, groups, std::less<typename std::iterator_traits<RandomIt>::value_type>(), threads);
+}
+
 #endif // PARALLELSORT_HPP
@@ -0,0 +1,247 @@
+/**
+* parallelSortAsync.hpp
+*
+ * Copyright (c) 2023 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef PARALLELSORTASYNC_HPP
+#define PARALLELSORTASYNC_HPP
+
+// parallelSortAsync starts a parallelSort on pool threads and returns immediately with a sortFuture.
+// The calling thread is free to do other work and later waits on, polls or co_awaits the sortFuture.
+// The sort is the same segment sort and merge levels as parallelSort, but each segment sort and each merge
+// partition is a pool task, and the last task of each level starts the next level.  So no thread ever blocks
+// waiting on another, and completion is signalled once through a single counter rather than a future per segment.
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "parallelSort.hpp"
+#include "threadPool.hpp"
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#include <coroutine>
+#define PARALLELSORT_HAS_COROUTINES 1
+#endif
+
+// asyncCompletion is the shared state between a running async sort and its sortFuture.
+class asyncCompletion {
+  std::mutex lock_;
+  std::condition_variable cv_;
+  bool done_ = false;
+  std::function<void()> continuation_;
+
+public:
+  void complete() {
+    std::function<void()> next;
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      done_ = true;
+      next.swap(continuation_);
+      cv_.notify_all();
+    }
+    if (next) next();
+  }
+
+  bool ready() {
+    std::lock_guard<std::mutex> guard(lock_);
+    return done_;
+  }
+
+  void wait() {
+    std::unique_lock<std::mutex> guard(lock_);
+    cv_.wait(guard, [this] { return done_; });
+  }
+
+  // run fn when the sort completes, on the pool thread that completes it.  Returns false without
+  // storing fn if the sort is already complete.
+  bool setContinuation(std::function<void()> fn) {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (done_) return false;
+    continuation_ = std::move(fn);
+    return true;
+  }
+};
+
+// sortFuture is the handle returned by parallelSortAsync.  The sorted data must not be touched until
+// ready() returns true, wait() returns or a co_await on it resumes.
+class sortFuture {
+  std::shared_ptr<asyncCompletion> state_;
+
+public:
+  sortFuture() {}
+  explicit sortFuture(std::shared_ptr<asyncCompletion> state) : state_(std::move(state)) {}
+
+  bool valid() const { return state_ != nullptr; }
+  bool ready() const { return state_ == nullptr || state_->ready(); }
+  void wait() const { if (state_ != nullptr) state_->wait(); }
+
+  // call fn on completion, or right away if the sort is already complete.
+  void then(std::function<void()> fn) const {
+    if (state_ == nullptr || !state_->setContinuation(fn)) fn();
+  }
+
+#ifdef PARALLELSORT_HAS_COROUTINES
+  // co_await on a sortFuture suspends the coroutine until the sort completes.  It is resumed on the pool thread
+  // that finished the sort, or not suspended at all if the sort is already done.
+  struct awaiter {
+    std::shared_ptr<asyncCompletion> state;
+    bool await_ready() const { return state == nullptr || state->ready(); }
+    bool await_suspend(std::coroutine_handle<> h) {
+      return state->setContinuation([h]() { h.resume(); });
+    }
+    void await_resume() const {}
+  };
+  awaiter operator co_await() const { return awaiter{ state_ }; }
+#endif
+};
+
+// asyncSortState holds everything one async sort needs while its tasks run on the pool.
+template< class RandomIt, class CF>
+class asyncSortState : public std::enable_shared_from_this<asyncSortState<RandomIt, CF>> {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+
+  struct mergeTask {
+    size_t aBeg, aEnd, bBeg, bEnd, dBeg;  // same meaning as the parallelMerge arguments, ends exclusive
+    bool toSwap;
+  };
+
+  RandomIt begin_;
+  size_t len_;
+  CF compFunc_;
+  size_t threads_;
+  threadPool& pool_;
+  double delta_;
+  size_t width_ = 1;       // the number of sorted segments in each run at the current level
+  bool inSwap_ = false;    // true when the current runs are in swap_
+  std::vector<T> swap_;
+  std::atomic<int64_t> pending_{ 0 };
+  std::vector<mergeTask> tasks_;
+  std::shared_ptr<asyncCompletion> completion_;
+
+  size_t bound(size_t seg) const { return seg >= threads_ ? len_ : (size_t)llround(double(seg) * delta_); }
+
+  // each task calls finishTask when it is done.  The last one of a level starts the next level.
+  void finishTask() {
+    if (--pending_ == 0) nextLevel();
+  }
+
+  template<class RandomItD, class RandomItS>
+  void runMerge(RandomItD dst, RandomItS src, const mergeTask& m) {
+    if (m.aBeg == m.aEnd) std::copy(src + m.bBeg, src + m.bEnd, dst + m.dBeg);
+    else if (m.bBeg == m.bEnd) std::copy(src + m.aBeg, src + m.aEnd, dst + m.dBeg);
+    else mergeFF(dst, src, m.aBeg, m.aEnd - 1, m.bBeg, m.bEnd - 1, m.dBeg, compFunc_);
+  }
+
+  // plan the merges of the current level, splitting each one into partitions in proportion to its size,
+  // and submit them to the pool.  When there is only one run left, complete the sort.
+  void nextLevel() {
+    auto self = this->shared_from_this();
+    if (width_ >= threads_) {
+      if (!inSwap_) {
+        completion_->complete();
+        return;
+      }
+      // the result is in swap, so copy it back in threads_ pieces.
+      tasks_.clear();
+      for (size_t t = 0; t < threads_; t++) tasks_.push_back({ bound(t), bound(t + 1), bound(t + 1), bound(t + 1), bound(t), false });
+      inSwap_ = false;
+      width_ = threads_ * 2;  // the next level completes
+    }
+    else {
+      tasks_.clear();
+      auto src = begin_;
+      T* sw = swap_.data();
+      for (size_t seg = 0; seg < threads_; seg += 2 * width_) {
+        size_t lb = bound(seg), lm = bound(seg + width_), le = bound(seg + 2 * width_);
+        size_t parts = maximum((size_t)llround(double(threads_) * double(le - lb) / double(len_)), 1);
+        parts = minimum(parts, maximum((le - lb) / 128, 1));
+        if (lm == le) parts = 1;
+        int64_t aCount = lm - lb, bCount = le - lm;
+        double spacing = double(le - lb) / double(parts);
+        size_t prevA = 0, prevGrid = 0;
+        for (size_t p = 1; p <= parts; p++) {
+          size_t grid = p == parts ? (size_t)(le - lb) : (size_t)llround(double(p) * spacing);
+          size_t a;
+          if (p == parts) a = aCount;
+          else if (inSwap_) a = mergePath(sw + lb, aCount, sw + lm, bCount, grid, compFunc_, 1);
+          else a = mergePath(src + lb, aCount, src + lm, bCount, grid, compFunc_, 1);
+          tasks_.push_back({ lb + prevA, lb + a, lm + (prevGrid - prevA), lm + (grid - a), lb + prevGrid, !inSwap_ });
+          prevA = a;
+          prevGrid = grid;
+        }
+      }
+      inSwap_ = !inSwap_;
+      width_ *= 2;
+    }
+    // the last task may start the next level before this loop ends, so do not look at tasks_ after the submits.
+    const size_t n = tasks_.size();
+    pending_ = (int64_t)n;
+    for (size_t t = 0; t < n; t++) {
+      pool_.submit([self, t]() {
+        const mergeTask& m = self->tasks_[t];
+        if (m.toSwap) self->runMerge(self->swap_.data(), self->begin_, m);
+        else self->runMerge(self->begin_, self->swap_.data(), m);
+        self->finishTask();
+        });
+    }
+  }
+
+public:
+  asyncSortState(RandomIt begin, RandomIt end, CF compFunc, size_t threads, threadPool& pool)
+    : begin_(begin), len_(end - begin), compFunc_(compFunc), threads_(threads), pool_(pool),
+    completion_(std::make_shared<asyncCompletion>()) {
+    delta_ = double(len_) / double(threads_);
+  }
+
+  std::shared_ptr<asyncCompletion> completion() { return completion_; }
+
+  // submit the segment sorts.  The last one to finish starts the first merge level.
+  void start() {
+    auto self = this->shared_from_this();
+    if (threads_ > 1) swap_.resize(len_);
+    pending_ = (int64_t)threads_;
+    for (size_t t = 0; t < threads_; t++) {
+      pool_.submit([self, t]() {
+        std::sort(self->begin_ + self->bound(t), self->begin_ + self->bound(t + 1), self->compFunc_);
+        self->finishTask();
+        });
+    }
+  }
+};
+
+// parallelSortAsync sorts [begin, end) like parallelSort but returns as soon as the work is queued on pool.
+// threads is the number of segments the data is sorted in and the number of partitions in each merge level.
+// The default is the size of the pool.
+template< class RandomIt, class CF>
+sortFuture parallelSortAsync(RandomIt begin, RandomIt end, CF compFunc, size_t threads = 0, threadPool& pool = globalThreadPool()) {
+  if (threads == 0) threads = pool.size();
+  const size_t len = end - begin;
+  if (len < 2) {
+    auto done = std::make_shared<asyncCompletion>();
+    done->complete();
+    return sortFuture(done);
+  }
+  // limit the number of threads so that there are at least 128 values / thread.
+  size_t max_threads = (len + 64) / 128LL;
+  max_threads = maximum(max_threads, 1);
+  threads = minimum(threads, max_threads);
+
+  auto state = std::make_shared<asyncSortState<RandomIt, CF>>(begin, end, compFunc, threads, pool);
+  sortFuture future(state->completion());
+  state->start();
+  return future;
+}
+
+template< class RandomIt>
+sortFuture parallelSortAsync(RandomIt begin, RandomIt end, size_t threads = 0, threadPool& pool = globalThreadPool()) {
+  return parallelSortAsync(begin, end, std::less<typename std::iterator_traits<RandomIt>::value_type>(), threads, pool);
+}
+
+#endif // PARALLELSORTASYNC_HPP
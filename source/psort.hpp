@@ -0,0 +1,276 @@
+/**
+* psort.hpp
+*
+ * Copyright (c) 2023 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef PSORT_HPP
+#define PSORT_HPP
+
+// psort.hpp is a front end in the style of the standard parallel algorithms.  Code written as
+//   std::sort(std::execution::par, v.begin(), v.end(), comp);
+// becomes
+//   psort::sort(psort::par, v.begin(), v.end(), comp);
+// and is run by this library.  The standard policy objects are accepted as well, so changing only the std:: of
+// the algorithm to psort:: is enough to A/B test against the standard library.
+// The policies are
+//   psort::seq                 run serially on the calling thread with the std:: algorithm
+//   psort::par, par_unseq      run in parallel on the default executor with hardware_concurrency() threads
+//   psort::par(threads)        run in parallel with the given number of threads
+//   psort::par.on(exec)        run in parallel on an executor, such as a poolExecutor, see parallelFor.hpp
+// par_unseq is treated the same as par.
+// The algorithms are sort, stable_sort, merge, partial_sort and nth_element.
+
+#include <stdint.h>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+#include "parallelSort.hpp"
+
+#if defined(__has_include)
+#if __has_include(<execution>) && __cplusplus >= 201703L
+#include <execution>
+#endif
+#endif
+
+namespace psort {
+
+namespace execution {
+
+// sequenced_policy runs the algorithm serially.
+struct sequenced_policy {};
+
+// executor_policy runs the algorithm on exec with threads threads, or exec.concurrency() threads when threads is 0.
+template<class E>
+struct executor_policy {
+  E* exec;
+  size_t threads;
+};
+
+// parallel_policy runs the algorithm on the default executor.  threads = 0 means the default thread count.
+struct parallel_policy {
+  size_t threads = 0;
+
+  parallel_policy operator()(size_t t) const {
+    parallel_policy p;
+    p.threads = t;
+    return p;
+  }
+
+  template<class E>
+  executor_policy<E> on(E& exec, size_t t = 0) const {
+    return executor_policy<E>{ &exec, t == 0 ? threads : t };
+  }
+};
+
+struct parallel_unsequenced_policy : parallel_policy {};
+
+constexpr sequenced_policy seq{};
+constexpr parallel_policy par{};
+constexpr parallel_unsequenced_policy par_unseq{};
+
+} // namespace execution
+
+using execution::seq;
+using execution::par;
+using execution::par_unseq;
+
+namespace detail {
+
+template<class P> struct isPolicy : std::false_type {};
+template<> struct isPolicy<execution::sequenced_policy> : std::true_type {};
+template<> struct isPolicy<execution::parallel_policy> : std::true_type {};
+template<> struct isPolicy<execution::parallel_unsequenced_policy> : std::true_type {};
+template<class E> struct isPolicy<execution::executor_policy<E>> : std::true_type {};
+#ifdef __cpp_lib_execution
+template<> struct isPolicy<std::execution::sequenced_policy> : std::true_type {};
+template<> struct isPolicy<std::execution::parallel_policy> : std::true_type {};
+template<> struct isPolicy<std::execution::parallel_unsequenced_policy> : std::true_type {};
+#endif
+
+template<class P, class R = void>
+using ifPolicy = typename std::enable_if<isPolicy<typename std::decay<P>::type>::value, R>::type;
+
+// run calls fn(executor, threads) with the executor and thread count the policy asks for.
+// Serial policies run on an inlineExecutor with one thread, which makes each algorithm its std:: equivalent.
+template<class F>
+void run(const execution::sequenced_policy&, F fn) {
+  inlineExecutor exec;
+  fn(exec, (size_t)1);
+}
+
+template<class F>
+void run(const execution::parallel_policy& p, F fn) {
+  fn(defaultExecutor(), p.threads);
+}
+
+template<class E, class F>
+void run(const execution::executor_policy<E>& p, F fn) {
+  fn(*p.exec, p.threads);
+}
+
+#ifdef __cpp_lib_execution
+template<class F>
+void run(const std::execution::sequenced_policy&, F fn) { run(seq, fn); }
+template<class F>
+void run(const std::execution::parallel_policy&, F fn) { run(par, fn); }
+template<class F>
+void run(const std::execution::parallel_unsequenced_policy&, F fn) { run(par_unseq, fn); }
+#endif
+
+// nthElement puts the element of rank nth in its sorted position with no larger element before it and no smaller one after it.
+// Two pivots that bracket the rank are picked from a sample.  The elements are split in parallel into those below,
+// between and above the pivots, and std::nth_element finishes on the band holding the rank, which is usually the
+// small middle band.
+template<class E, class RandomIt, class CF>
+void nthElement(E& exec, RandomIt first, RandomIt nth, RandomIt last, CF comp, size_t threads) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  if (threads == 0) threads = exec.concurrency();
+  const size_t len = last - first;
+  if (nth == last) return;
+  threads = minimum(threads, maximum(len / 4096, 1));
+  if (threads <= 1) {
+    std::nth_element(first, nth, last, comp);
+    return;
+  }
+
+  // sample about 32 elements per thread, sort the sample and take pivots just below and above the rank.
+  const size_t rank = nth - first;
+  const size_t samples = minimum(len, 32 * threads + 1);
+  std::vector<T> sample(samples);
+  for (size_t i = 0; i < samples; i++) sample[i] = *(first + (size_t)((double(i) + 0.5) * double(len) / double(samples)));
+  std::sort(sample.begin(), sample.end(), comp);
+  double pos = double(rank) * double(samples) / double(len);
+  double margin = 2.0 * std::sqrt(double(samples));
+  const T lo = sample[(size_t)maximum(0.0, pos - margin)];
+  const T hi = sample[(size_t)minimum(double(samples - 1), pos + margin)];
+
+  // class 0 is below lo, class 2 is above hi, class 1 is in between.
+  auto classify = [&](const T& v) { return comp(v, lo) ? 0 : (comp(hi, v) ? 2 : 1); };
+  double delta = double(len) / double(threads);
+  std::vector<size_t> counts(3 * threads, 0);
+  parallelFor(exec, (int64_t)0, (int64_t)threads, [&](int64_t t) {
+    size_t lb = llround(t * delta), le = t == (int64_t)threads - 1 ? len : llround((t + 1) * delta);
+    for (size_t i = lb; i < le; i++) counts[3 * t + classify(*(first + i))]++;
+    }, threads);
+
+  // exclusive prefix over class, then thread, gives each thread's write position for each class.
+  std::vector<size_t> offsets(3 * threads);
+  size_t total = 0;
+  size_t bandStart[4];
+  for (int c = 0; c < 3; c++) {
+    bandStart[c] = total;
+    for (size_t t = 0; t < threads; t++) {
+      offsets[3 * t + c] = total;
+      total += counts[3 * t + c];
+    }
+  }
+  bandStart[3] = len;
+
+  std::vector<T> scratch(len);
+  parallelFor(exec, (int64_t)0, (int64_t)threads, [&](int64_t t) {
+    size_t lb = llround(t * delta), le = t == (int64_t)threads - 1 ? len : llround((t + 1) * delta);
+    size_t pos[3] = { offsets[3 * t], offsets[3 * t + 1], offsets[3 * t + 2] };
+    for (size_t i = lb; i < le; i++) {
+      const T& v = *(first + i);
+      scratch[pos[classify(v)]++] = v;
+    }
+    }, threads);
+  parallelForRange(exec, (size_t)0, len, [&](size_t lb, size_t le) {
+    std::copy(scratch.begin() + lb, scratch.begin() + le, first + lb);
+    }, 1, schedStatic, threads);
+
+  // finish in the band that holds the rank.
+  int band = rank < bandStart[1] ? 0 : (rank < bandStart[2] ? 1 : 2);
+  std::nth_element(first + bandStart[band], nth, first + bandStart[band + 1], comp);
+}
+
+// mergeRanges merges [first1, last1) and [first2, last2) into d_first like std::merge, in threads partitions.
+template<class E, class It1, class It2, class OutIt, class CF>
+OutIt mergeRanges(E& exec, It1 first1, It1 last1, It2 first2, It2 last2, OutIt d_first, CF comp, size_t threads) {
+  if (threads == 0) threads = exec.concurrency();
+  const int64_t aCount = last1 - first1, bCount = last2 - first2;
+  const size_t len = aCount + bCount;
+  threads = minimum(threads, maximum(len / 4096, 1));
+  double spacing = double(len) / double(threads);
+  std::vector<size_t> mpi(threads + 1);
+  mpi[0] = 0;
+  mpi[threads] = aCount;
+  for (size_t i = 1; i < threads; i++) mpi[i] = mergePathStable(first1, aCount, first2, bCount, llround(i * spacing), comp);
+  parallelFor(exec, (int64_t)0, (int64_t)threads, [&](int64_t t) {
+    size_t grid = llround(t * spacing);
+    size_t gridEnd = t == (int64_t)threads - 1 ? len : (size_t)llround((t + 1) * spacing);
+    std::merge(first1 + mpi[t], first1 + mpi[t + 1], first2 + (grid - mpi[t]), first2 + (gridEnd - mpi[t + 1]), d_first + grid, comp);
+    }, threads);
+  return d_first + len;
+}
+
+} // namespace detail
+
+template<class P, class RandomIt, class CF>
+detail::ifPolicy<P> sort(P&& policy, RandomIt first, RandomIt last, CF comp) {
+  detail::run(policy, [&](auto& exec, size_t threads) { parallelSort(exec, first, last, comp, threads); });
+}
+
+template<class P, class RandomIt>
+detail::ifPolicy<P> sort(P&& policy, RandomIt first, RandomIt last) {
+  psort::sort(policy, first, last, std::less<typename std::iterator_traits<RandomIt>::value_type>());
+}
+
+template<class P, class RandomIt, class CF>
+detail::ifPolicy<P> stable_sort(P&& policy, RandomIt first, RandomIt last, CF comp) {
+  detail::run(policy, [&](auto& exec, size_t threads) { parallelStableSort(exec, first, last, comp, threads); });
+}
+
+template<class P, class RandomIt>
+detail::ifPolicy<P> stable_sort(P&& policy, RandomIt first, RandomIt last) {
+  psort::stable_sort(policy, first, last, std::less<typename std::iterator_traits<RandomIt>::value_type>());
+}
+
+template<class P, class It1, class It2, class OutIt, class CF>
+detail::ifPolicy<P, OutIt> merge(P&& policy, It1 first1, It1 last1, It2 first2, It2 last2, OutIt d_first, CF comp) {
+  OutIt result = d_first;
+  detail::run(policy, [&](auto& exec, size_t threads) { result = detail::mergeRanges(exec, first1, last1, first2, last2, d_first, comp, threads); });
+  return result;
+}
+
+template<class P, class It1, class It2, class OutIt>
+detail::ifPolicy<P, OutIt> merge(P&& policy, It1 first1, It1 last1, It2 first2, It2 last2, OutIt d_first) {
+  return psort::merge(policy, first1, last1, first2, last2, d_first, std::less<typename std::iterator_traits<It1>::value_type>());
+}
+
+template<class P, class RandomIt, class CF>
+detail::ifPolicy<P> nth_element(P&& policy, RandomIt first, RandomIt nth, RandomIt last, CF comp) {
+  detail::run(policy, [&](auto& exec, size_t threads) { detail::nthElement(exec, first, nth, last, comp, threads); });
+}
+
+template<class P, class RandomIt>
+detail::ifPolicy<P> nth_element(P&& policy, RandomIt first, RandomIt nth, RandomIt last) {
+  psort::nth_element(policy, first, nth, last, std::less<typename std::iterator_traits<RandomIt>::value_type>());
+}
+
+// partial_sort selects the smallest middle - first elements with nth_element and then sorts them.
+template<class P, class RandomIt, class CF>
+detail::ifPolicy<P> partial_sort(P&& policy, RandomIt first, RandomIt middle, RandomIt last, CF comp) {
+  detail::run(policy, [&](auto& exec, size_t threads) {
+    if (threads == 1) {
+      std::partial_sort(first, middle, last, comp);
+      return;
+    }
+    if (middle != last) detail::nthElement(exec, first, middle, last, comp, threads);
+    parallelSort(exec, first, middle, comp, threads);
+    });
+}
+
+template<class P, class RandomIt>
+detail::ifPolicy<P> partial_sort(P&& policy, RandomIt first, RandomIt middle, RandomIt last) {
+  psort::partial_sort(policy, first, middle, last, std::less<typename std::iterator_traits<RandomIt>::value_type>());
+}
+
+} // namespace psort
+
+#endif // PSORT_HPP
@@ -0,0 +1,130 @@
+/**
+* sortFixed.hpp
+*
+ * Copyright (c) 2023 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef SORTFIXED_HPP
+#define SORTFIXED_HPP
+
+// sortFixed<N>(p) sorts the N elements at p with a sorting network, for sizes known at compile time up to
+// sortFixedMax.  A sorting network is a fixed list of compare-exchanges, so there are no loops: the list is generated
+// at compile time and unrolled.  For arithmetic types each compare-exchange becomes a min and a max, so there are no
+// data-dependent branches either, and the compiler can keep the whole array in registers.  Other types are swapped
+// with a move when they are out of order.  The networks are Batcher's odd-even merge
+// sorts, cut down from the next power of 2 to N.  They are optimal up to N = 8 and within a few compare-exchanges of
+// the best known networks above that, 543 for N = 64.
+// sortFixed is for sorting many small groups, such as the neighbors of each point or the columns of a small tuple,
+// where the thread setup of parallelSort and even the size checks of std::sort cost more than the sort.
+
+#include <stddef.h>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+const size_t sortFixedMax = 64;
+
+template<size_t N>
+class sortingNetwork {
+  static constexpr size_t padded() {
+    size_t p = 1;
+    while (p < N) p *= 2;
+    return p;
+  }
+
+  // generate calls emit(i, j) for each compare-exchange of Batcher's odd-even merge sort of padded() elements, leaving out
+  // those that touch an element at N or above.  Those elements would be larger than all the others, so the
+  // compare-exchanges with them never exchange.
+  template<class F>
+  static constexpr void generate(F& emit) {
+    const size_t n = padded();
+    for (size_t p = 1; p < n; p *= 2) {
+      for (size_t k = p; k >= 1; k /= 2) {
+        for (size_t j = k % p; j + k < n; j += 2 * k) {
+          for (size_t i = 0; i < k && i + j + k < n; i++) {
+            if ((i + j) / (2 * p) == (i + j + k) / (2 * p) && i + j + k < N) emit(i + j, i + j + k);
+          }
+        }
+      }
+    }
+  }
+
+  struct counter {
+    size_t count = 0;
+    constexpr void operator()(size_t, size_t) { count++; }
+  };
+
+  static constexpr size_t countPairs() {
+    counter c;
+    generate(c);
+    return c.count;
+  }
+
+public:
+  static constexpr size_t size = countPairs();
+
+  // the compare-exchanges, with one extra unused entry so that the arrays are never empty.
+  struct pairs {
+    size_t lo[size + 1] = {};
+    size_t hi[size + 1] = {};
+    size_t count = 0;
+    constexpr void operator()(size_t i, size_t j) {
+      lo[count] = i;
+      hi[count] = j;
+      count++;
+    }
+  };
+
+  static constexpr pairs build() {
+    pairs p;
+    generate(p);
+    return p;
+  }
+
+  static constexpr pairs network = build();
+};
+
+// compareExchange puts the smaller of a and b by compFunc in a and the larger in b.  Arithmetic types take a std::min
+// and a std::max, which compile to branch-free min and max or conditional moves.  The max is taken with its arguments
+// swapped so that when a and b are equivalent both are kept.  Other types, such as std::string, are swapped with
+// std::swap, which moves them instead of copying.  The std::true_type version is for the arithmetic types.
+template<class T, class CF>
+inline void compareExchange(T& a, T& b, CF& compFunc, std::true_type) {
+  const T lo = std::min(a, b, compFunc);
+  const T hi = std::max(b, a, compFunc);
+  a = lo;
+  b = hi;
+}
+
+template<class T, class CF>
+inline void compareExchange(T& a, T& b, CF& compFunc, std::false_type) {
+  if (compFunc(b, a)) std::swap(a, b);
+}
+
+// applySortingNetwork runs compare-exchange I of the network for each I.  The positions are template arguments, so
+// they are constants in the unrolled code, and the expansion in an array initializer runs them in order.
+template<size_t N, class T, class CF, size_t... I>
+inline void applySortingNetwork(T* p, CF& compFunc, std::index_sequence<I...>) {
+  (void)p;
+  (void)compFunc;
+  int expand[] = { 0, (compareExchange(p[std::integral_constant<size_t, sortingNetwork<N>::network.lo[I]>::value],
+    p[std::integral_constant<size_t, sortingNetwork<N>::network.hi[I]>::value], compFunc, std::is_arithmetic<T>()), 0)... };
+  (void)expand;
+}
+
+// sortFixed sorts the N elements at p by compFunc.  The sort is not stable.
+template<size_t N, class T, class CF>
+inline void sortFixed(T* p, CF compFunc) {
+  static_assert(N <= sortFixedMax, "sortFixed sorts at most sortFixedMax elements");
+  applySortingNetwork<N>(p, compFunc, std::make_index_sequence<sortingNetwork<N>::size>());
+}
+
+template<size_t N, class T>
+inline void sortFixed(T* p) {
+  sortFixed<N>(p, std::less<T>());
+}
+
+#endif // SORTFIXED_HPP
@@ -0,0 +1,200 @@
+/**
+* sortRecords.hpp
+*
+ * Copyright (c) 2023 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef SORTRECORDS_HPP
+#define SORTRECORDS_HPP
+
+// sortRecords sorts fixed width records whose layout is only known at run time, such as the rows of a storage engine,
+// without generating code for each layout.
+//   recordKey keys[] = { { 0, 4, keySigned, false }, { 8, 10, keyBytes, true } };
+//   sortRecords(buffer, n, 100, keys, 2, threads);
+// sorts n records of 100 bytes by the int32_t at offset 0 and then by the 10 bytes at offset 8, descending.
+// The key fields of each record are packed into a normalizedKey of 1 to 4 words with the record's position, the keys
+// are sorted with parallelSort, and the records are moved into order through a copy with memcpy.  The keys and the
+// moves are compiled for a fixed set of key and record widths, so one binary handles any layout at close to the speed
+// of a templated sort.  Keys longer than 256 bits are sorted by comparing the fields of the records instead.
+// Records with equal keys stay in input order.
+
+#include <stdint.h>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "parallelSort.hpp"
+#include "parallelPermute.hpp"
+#include "normalizedKey.hpp"
+
+// the type of a key field.  keyUnsigned and keySigned are 1, 2, 4 or 8 byte integers and keyFloat a 4 byte float or
+// an 8 byte double, all in the byte order of the machine.  keyBytes is compared byte by byte like memcmp.
+enum recordKeyType { keyUnsigned, keySigned, keyFloat, keyBytes };
+
+// recordKey describes one key field, the most significant first.
+struct recordKey {
+  size_t offset;
+  size_t length;
+  recordKeyType type;
+  bool descending;
+};
+
+// appendRecordKey adds the field described by k of the record at rec to b.
+template<size_t Words>
+inline void appendRecordKey(keyBuilder<Words>& b, const unsigned char* rec, const recordKey& k) {
+  const unsigned char* p = rec + k.offset;
+  switch (k.type) {
+  case keyUnsigned:
+  case keySigned: {
+    // load the field as an unsigned value; flipping the sign bit orders signed values as keyBuilder::add does.
+    const uint64_t sign = k.type == keySigned ? (uint64_t)1 << (k.length * 8 - 1) : 0;
+    if (k.length == 8) {
+      uint64_t u;
+      memcpy(&u, p, 8);
+      b.add((uint64_t)(u ^ sign), k.descending);
+    }
+    else if (k.length == 4) {
+      uint32_t u;
+      memcpy(&u, p, 4);
+      b.add((uint32_t)(u ^ sign), k.descending);
+    }
+    else if (k.length == 2) {
+      uint16_t u;
+      memcpy(&u, p, 2);
+      b.add((uint16_t)(u ^ sign), k.descending);
+    }
+    else b.add((uint8_t)(*p ^ sign), k.descending);
+    break;
+  }
+  case keyFloat: {
+    if (k.length == 4) {
+      float f;
+      memcpy(&f, p, 4);
+      b.add(f, k.descending);
+    }
+    else {
+      double d;
+      memcpy(&d, p, 8);
+      b.add(d, k.descending);
+    }
+    break;
+  }
+  case keyBytes: {
+    b.addBytes(p, k.length, k.descending);
+    break;
+  }
+  }
+}
+
+// compareRecordKeys compares the key fields of two records, for keys too long for a normalizedKey.
+inline int compareRecordKeys(const unsigned char* a, const unsigned char* b, const recordKey* keys, size_t keyCount) {
+  for (size_t k = 0; k < keyCount; k++) {
+    int c;
+    if (keys[k].type == keyBytes) c = memcmp(a + keys[k].offset, b + keys[k].offset, keys[k].length);
+    else {
+      keyBuilder<1> ka, kb;
+      appendRecordKey(ka, a, keys[k]);
+      appendRecordKey(kb, b, keys[k]);
+      c = ka.key() < kb.key() ? -1 : (kb.key() < ka.key() ? 1 : 0);
+    }
+    if (keys[k].type == keyBytes && keys[k].descending) c = -c;
+    if (c != 0) return c;
+  }
+  return 0;
+}
+
+// moveRecords puts the records of data in the order of order, through a copy.  W is the record width, or 0 for the
+// widths that have no kernel of their own, which are copied with a memcpy of width bytes.
+template<size_t W>
+void moveRecords(unsigned char* data, size_t n, size_t width, const size_t* order, size_t threads) {
+  if (W != 0) width = W;
+  std::vector<unsigned char> sorted(n * width);
+  parallelForRange((size_t)0, n, [&](size_t lb, size_t le) {
+    unsigned char* out = sorted.data();
+    size_t i = lb;
+    for (; i + permutePrefetchDistance < le; i++) {
+      permutePrefetchRead(data + order[i + permutePrefetchDistance] * width);
+      memcpy(out + i * width, data + order[i] * width, W != 0 ? W : width);
+    }
+    for (; i < le; i++) memcpy(out + i * width, data + order[i] * width, W != 0 ? W : width);
+    }, 4096, schedStatic, (int64_t)threads);
+  parallelForRange((size_t)0, n, [&](size_t lb, size_t le) {
+    memcpy(data + lb * width, sorted.data() + lb * width, (le - lb) * width);
+    }, 4096, schedStatic, (int64_t)threads);
+}
+
+inline void moveRecords(unsigned char* data, size_t n, size_t width, const size_t* order, size_t threads) {
+  switch (width) {
+  case 4: moveRecords<4>(data, n, width, order, threads); break;
+  case 8: moveRecords<8>(data, n, width, order, threads); break;
+  case 12: moveRecords<12>(data, n, width, order, threads); break;
+  case 16: moveRecords<16>(data, n, width, order, threads); break;
+  case 24: moveRecords<24>(data, n, width, order, threads); break;
+  case 32: moveRecords<32>(data, n, width, order, threads); break;
+  case 48: moveRecords<48>(data, n, width, order, threads); break;
+  case 64: moveRecords<64>(data, n, width, order, threads); break;
+  case 100: moveRecords<100>(data, n, width, order, threads); break;
+  case 128: moveRecords<128>(data, n, width, order, threads); break;
+  case 256: moveRecords<256>(data, n, width, order, threads); break;
+  default: moveRecords<0>(data, n, width, order, threads); break;
+  }
+}
+
+// sortRecordsByKeyWords sorts with keys of Words words.
+template<size_t Words>
+void sortRecordsByKeyWords(unsigned char* data, size_t n, size_t width, const recordKey* keys, size_t keyCount, size_t threads) {
+  typedef keyedIndex<Words> KI;
+  std::vector<KI> keyed(n);
+  parallelForRange((size_t)0, n, [&](size_t lb, size_t le) {
+    for (size_t i = lb; i < le; i++) {
+      keyBuilder<Words> b;
+      for (size_t k = 0; k < keyCount; k++) appendRecordKey(b, data + i * width, keys[k]);
+      keyed[i].key = b.key();
+      keyed[i].index = i;
+    }
+    }, 4096, schedStatic, (int64_t)threads);
+  parallelSort(keyed.begin(), keyed.end(), std::less<KI>(), threads);
+  std::vector<size_t> order(n);
+  parallelForRange((size_t)0, n, [&](size_t lb, size_t le) {
+    for (size_t i = lb; i < le; i++) order[i] = keyed[i].index;
+    }, 4096, schedStatic, (int64_t)threads);
+  moveRecords(data, n, width, order.data(), threads);
+}
+
+// sortRecords sorts n records of width bytes at data by the keyCount key fields of keys.  threads = 0 means the
+// hardware concurrency.  It throws std::runtime_error if a key field does not fit in the record or has a length
+// its type does not allow.
+inline void sortRecords(void* data, size_t n, size_t width, const recordKey* keys, size_t keyCount, size_t threads = 0) {
+  size_t keyBits = 0;
+  for (size_t k = 0; k < keyCount; k++) {
+    const recordKey& key = keys[k];
+    const bool integer = key.type == keyUnsigned || key.type == keySigned;
+    bool lengthOk = integer ? (key.length == 1 || key.length == 2 || key.length == 4 || key.length == 8) :
+      (key.type == keyFloat ? (key.length == 4 || key.length == 8) : (key.type == keyBytes && key.length > 0));
+    if (!lengthOk) throw std::runtime_error("sortRecords: key field " + std::to_string(k) + " has a bad type or length");
+    if (key.offset + key.length > width) throw std::runtime_error("sortRecords: key field " + std::to_string(k) + " is past the end of the record");
+    keyBits += key.length * 8;
+  }
+  if (n < 2 || keyCount == 0) return;
+  unsigned char* bytes = (unsigned char*)data;
+  if (keyBits <= 64) sortRecordsByKeyWords<1>(bytes, n, width, keys, keyCount, threads);
+  else if (keyBits <= 128) sortRecordsByKeyWords<2>(bytes, n, width, keys, keyCount, threads);
+  else if (keyBits <= 192) sortRecordsByKeyWords<3>(bytes, n, width, keys, keyCount, threads);
+  else if (keyBits <= 256) sortRecordsByKeyWords<4>(bytes, n, width, keys, keyCount, threads);
+  else {
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; i++) order[i] = i;
+    parallelStableSort(order.begin(), order.end(), [bytes, width, keys, keyCount](size_t a, size_t b) {
+      return compareRecordKeys(bytes + a * width, bytes + b * width, keys, keyCount) < 0;
+      }, threads);
+    moveRecords(bytes, n, width, order.data(), threads);
+  }
+}
+
+inline void sortRecords(void* data, size_t n, size_t width, const std::vector<recordKey>& keys, size_t threads = 0) {
+  sortRecords(data, n, width, keys.data(), keys.size(), threads);
+}
+
+#endif // SORTRECORDS_HPP
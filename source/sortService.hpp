@@ -0,0 +1,422 @@
+/**
+* sortService.hpp
+*
+ * Copyright (c) 2023 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef SORTSERVICE_HPP
+#define SORTSERVICE_HPP
+
+// The sort service lets many processes on one host share a single set of sorting threads instead of
+// each parallelSort call starting its own.  A sortServiceServer (the daemon) listens on a Unix-domain
+// socket.  A sortServiceClient owns a POSIX shared memory buffer; to sort, it places the data in the
+// buffer and sends a small request naming the buffer over the socket.  The daemon sorts the data in
+// place in the shared memory and replies when it is done.
+// The daemon gathers all of the requests that arrive together.  Small requests are coalesced into a
+// batch whose segments are spread over the worker pool by total work, and large requests are run one
+// at a time with parallelSort on the same worker pool, so the daemon never sorts on more than its
+// configured number of threads no matter how many clients there are.
+// This code is POSIX only.
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <stdint.h>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "parallelSort.hpp"
+#include "threadPool.hpp"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// element types the service can sort.
+enum sortServiceType : uint32_t {
+  sstInt32 = 0,
+  sstUInt32 = 1,
+  sstInt64 = 2,
+  sstUInt64 = 3,
+  sstFloat = 4,
+  sstDouble = 5
+};
+
+template<class T> struct sortServiceTypeOf;
+template<> struct sortServiceTypeOf<int32_t> { static const sortServiceType value = sstInt32; };
+template<> struct sortServiceTypeOf<uint32_t> { static const sortServiceType value = sstUInt32; };
+template<> struct sortServiceTypeOf<int64_t> { static const sortServiceType value = sstInt64; };
+template<> struct sortServiceTypeOf<uint64_t> { static const sortServiceType value = sstUInt64; };
+template<> struct sortServiceTypeOf<float> { static const sortServiceType value = sstFloat; };
+template<> struct sortServiceTypeOf<double> { static const sortServiceType value = sstDouble; };
+
+const uint32_t sortServiceMagic = 0x50534f52;  // "PSOR"
+const uint32_t sortServiceDescending = 1;
+
+// wire format of a request and its reply.  The shared memory buffer is named by shmName and
+// the data to sort starts at the beginning of it.
+struct sortServiceRequest {
+  uint32_t magic;
+  uint32_t type;
+  uint32_t flags;
+  uint32_t reserved;
+  uint64_t count;
+  uint64_t shmSize;
+  char shmName[64];
+};
+
+struct sortServiceReply {
+  int32_t status;  // 0 on success
+  int32_t reserved;
+};
+
+inline bool sortServiceSend(int fd, const void* buf, size_t len) {
+  const char* p = static_cast<const char*>(buf);
+  while (len > 0) {
+    ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+inline bool sortServiceRecv(int fd, void* buf, size_t len) {
+  char* p = static_cast<char*>(buf);
+  while (len > 0) {
+    ssize_t n = recv(fd, p, len, 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+// sortServiceClient is one connection to the daemon.  It is not thread safe; use one client per thread.
+class sortServiceClient {
+  int fd_ = -1;
+  std::string shmName_;
+  void* shm_ = nullptr;
+  size_t shmSize_ = 0;
+  uint64_t generation_ = 0;
+
+  void fail(const std::string& what) {
+    throw std::runtime_error("sortServiceClient: " + what + ": " + strerror(errno));
+  }
+
+  void releaseShm() {
+    if (shm_ != nullptr) {
+      munmap(shm_, shmSize_);
+      shm_unlink(shmName_.c_str());
+      shm_ = nullptr;
+      shmSize_ = 0;
+    }
+  }
+
+  // make sure the shared buffer holds at least bytes.  A larger buffer gets a new name so the
+  // daemon notices the change and remaps it.
+  void reserve(size_t bytes) {
+    if (bytes <= shmSize_) return;
+    releaseShm();
+    size_t size = 1 << 16;
+    while (size < bytes) size *= 2;
+    shmName_ = "/psort." + std::to_string(getpid()) + "." + std::to_string((uintptr_t)this) + "." + std::to_string(generation_++);
+    int sfd = shm_open(shmName_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (sfd < 0) fail("shm_open");
+    if (ftruncate(sfd, size) != 0) {
+      close(sfd);
+      fail("ftruncate");
+    }
+    shm_ = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, sfd, 0);
+    close(sfd);
+    if (shm_ == MAP_FAILED) {
+      shm_ = nullptr;
+      fail("mmap");
+    }
+    shmSize_ = size;
+  }
+
+public:
+  explicit sortServiceClient(const std::string& socketPath) {
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd_ < 0) fail("socket");
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+    if (connect(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+      close(fd_);
+      fail("connect to " + socketPath);
+    }
+  }
+
+  ~sortServiceClient() {
+    releaseShm();
+    if (fd_ >= 0) close(fd_);
+  }
+
+  sortServiceClient(const sortServiceClient&) = delete;
+  sortServiceClient& operator=(const sortServiceClient&) = delete;
+
+  // buffer returns the shared memory buffer sized for n elements.  Data written there and sorted
+  // with sort(buffer, n) is not copied on the way in or out.  The pointer is invalidated by a
+  // later call that needs a larger buffer.
+  template<class T>
+  T* buffer(size_t n) {
+    reserve(n * sizeof(T));
+    return static_cast<T*>(shm_);
+  }
+
+  // sort n elements at data in ascending or descending order on the daemon.
+  template<class T>
+  void sort(T* data, size_t n, bool descending = false) {
+    if (n < 2) return;
+    T* buf = data;
+    if (data != shm_) {
+      buf = buffer<T>(n);
+      memcpy(buf, data, n * sizeof(T));
+    }
+    sortServiceRequest req;
+    memset(&req, 0, sizeof(req));
+    req.magic = sortServiceMagic;
+    req.type = sortServiceTypeOf<T>::value;
+    req.flags = descending ? sortServiceDescending : 0;
+    req.count = n;
+    req.shmSize = shmSize_;
+    strncpy(req.shmName, shmName_.c_str(), sizeof(req.shmName) - 1);
+    sortServiceReply reply;
+    if (!sortServiceSend(fd_, &req, sizeof(req)) || !sortServiceRecv(fd_, &reply, sizeof(reply))) fail("request");
+    if (reply.status != 0) throw std::runtime_error("sortServiceClient: daemon rejected request");
+    if (data != buf) memcpy(data, buf, n * sizeof(T));
+  }
+};
+
+// sortServiceServer is the daemon side.  run() serves clients until stop() is called.
+class sortServiceServer {
+  struct job {
+    sortServiceRequest req;
+    void* data = nullptr;
+    bool finished = false;
+    int32_t status = 0;
+  };
+
+  std::string path_;
+  size_t threads_;
+  size_t smallLimit_;
+  int listenFd_ = -1;
+  std::atomic<bool> stopping_{ false };
+  threadPool pool_;
+
+  std::mutex lock_;
+  std::condition_variable queueCv_;  // signals the dispatcher that work arrived
+  std::condition_variable doneCv_;   // signals connection threads that a job finished
+  std::deque<job*> queue_;
+  std::vector<std::thread> connections_;
+
+  // sort serially when threads is 1, else with parallelSort on the worker pool.
+  template<class T>
+  void sortTyped(void* data, uint64_t n, bool descending, size_t threads) {
+    T* d = static_cast<T*>(data);
+    if (threads <= 1) {
+      if (descending) std::sort(d, d + n, std::greater<T>());
+      else std::sort(d, d + n);
+    }
+    else {
+      poolExecutor exec(pool_);
+      if (descending) parallelSort(exec, d, d + n, std::greater<T>(), threads);
+      else parallelSort(exec, d, d + n, std::less<T>(), threads);
+    }
+  }
+
+  bool sortJob(job* j, size_t threads) {
+    bool desc = (j->req.flags & sortServiceDescending) != 0;
+    switch (j->req.type) {
+    case sstInt32: sortTyped<int32_t>(j->data, j->req.count, desc, threads); break;
+    case sstUInt32: sortTyped<uint32_t>(j->data, j->req.count, desc, threads); break;
+    case sstInt64: sortTyped<int64_t>(j->data, j->req.count, desc, threads); break;
+    case sstUInt64: sortTyped<uint64_t>(j->data, j->req.count, desc, threads); break;
+    case sstFloat: sortTyped<float>(j->data, j->req.count, desc, threads); break;
+    case sstDouble: sortTyped<double>(j->data, j->req.count, desc, threads); break;
+    default: return false;
+    }
+    return true;
+  }
+
+  static size_t elementSize(uint32_t type) {
+    switch (type) {
+    case sstInt32: case sstUInt32: case sstFloat: return 4;
+    case sstInt64: case sstUInt64: case sstDouble: return 8;
+    default: return 0;
+    }
+  }
+
+  void finish(job* j, int32_t status) {
+    std::lock_guard<std::mutex> guard(lock_);
+    j->status = status;
+    j->finished = true;
+    doneCv_.notify_all();
+  }
+
+  // serve one client connection.  Requests on a connection are handled one at a time.
+  void serveConnection(int fd) {
+    std::string mappedName;
+    void* mapped = nullptr;
+    size_t mappedSize = 0;
+    while (!stopping_) {
+      job j;
+      if (!sortServiceRecv(fd, &j.req, sizeof(j.req))) break;
+      j.req.shmName[sizeof(j.req.shmName) - 1] = 0;
+      size_t esize = elementSize(j.req.type);
+      int32_t status = 0;
+      if (j.req.magic != sortServiceMagic || esize == 0 || j.req.count > j.req.shmSize / esize) status = 1;
+      // keep the client's buffer mapped until it is replaced by a larger one.
+      if (status == 0 && (mapped == nullptr || mappedName != j.req.shmName || mappedSize != j.req.shmSize)) {
+        if (mapped != nullptr) munmap(mapped, mappedSize);
+        mapped = nullptr;
+        int sfd = shm_open(j.req.shmName, O_RDWR, 0);
+        if (sfd >= 0) {
+          void* p = mmap(nullptr, j.req.shmSize, PROT_READ | PROT_WRITE, MAP_SHARED, sfd, 0);
+          close(sfd);
+          if (p != MAP_FAILED) {
+            mapped = p;
+            mappedName = j.req.shmName;
+            mappedSize = j.req.shmSize;
+          }
+        }
+        if (mapped == nullptr) status = 2;
+      }
+      if (status == 0) {
+        j.data = mapped;
+        std::unique_lock<std::mutex> guard(lock_);
+        if (stopping_) status = 3;  // the dispatcher may already be gone
+        else {
+          queue_.push_back(&j);
+          queueCv_.notify_one();
+          doneCv_.wait(guard, [&j] { return j.finished; });
+          status = j.status;
+        }
+      }
+      sortServiceReply reply = { status, 0 };
+      if (!sortServiceSend(fd, &reply, sizeof(reply))) break;
+    }
+    if (mapped != nullptr) munmap(mapped, mappedSize);
+    close(fd);
+  }
+
+  // the dispatcher takes every job that is waiting, sorts the small ones as one batch on the pool
+  // and then runs the large ones with all of the threads.
+  void dispatch() {
+    while (true) {
+      std::vector<job*> jobs;
+      {
+        std::unique_lock<std::mutex> guard(lock_);
+        queueCv_.wait(guard, [this] { return stopping_ || !queue_.empty(); });
+        if (stopping_ && queue_.empty()) return;
+        jobs.assign(queue_.begin(), queue_.end());
+        queue_.clear();
+      }
+      std::vector<job*> small, large;
+      for (job* j : jobs) (j->req.count < smallLimit_ ? small : large).push_back(j);
+      runBatch(small);
+      for (job* j : large) finish(j, sortJob(j, threads_) ? 0 : 1);
+    }
+  }
+
+  // split the small jobs into at most threads_ groups of about equal n*log2(n) work and sort each group on a pool worker.
+  void runBatch(std::vector<job*>& small) {
+    if (small.empty()) return;
+    auto work = [](job* j) { return double(j->req.count) * std::log2(double(j->req.count) + 2.0); };
+    std::sort(small.begin(), small.end(), [](job* a, job* b) { return a->req.count > b->req.count; });
+    double total = 0;
+    for (job* j : small) total += work(j);
+    double share = total / double(minimum(threads_, small.size()));
+    taskGroup group;
+    size_t first = 0;
+    while (first < small.size()) {
+      size_t last = first;
+      double w = 0;
+      while (last < small.size() && (last == first || w + work(small[last]) <= share)) w += work(small[last++]);
+      pool_.submit(group, [this, &small, first, last]() {
+        for (size_t i = first; i < last; i++) finish(small[i], sortJob(small[i], 1) ? 0 : 1);
+        });
+      first = last;
+    }
+    group.wait();
+  }
+
+public:
+  // threads is the total number of sorting threads for all clients.  Requests with fewer than
+  // smallLimit elements are batched, larger ones get all of the threads.
+  sortServiceServer(const std::string& socketPath, size_t threads = 0, size_t smallLimit = 65536)
+    : path_(socketPath), threads_(threads == 0 ? std::thread::hardware_concurrency() : threads),
+    smallLimit_(smallLimit), pool_(threads_) {
+    listenFd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd_ < 0) throw std::runtime_error(std::string("sortServiceServer: socket: ") + strerror(errno));
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(socketPath.c_str());
+    if (bind(listenFd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listenFd_, 128) != 0) {
+      close(listenFd_);
+      throw std::runtime_error(std::string("sortServiceServer: bind/listen: ") + strerror(errno));
+    }
+  }
+
+  ~sortServiceServer() {
+    stop();
+    unlink(path_.c_str());
+  }
+
+  // accept clients and serve them until stop() is called.
+  void run() {
+    std::thread dispatcher([this] { dispatch(); });
+    while (!stopping_) {
+      int fd = accept(listenFd_, nullptr, nullptr);
+      if (fd < 0) {
+        if (errno == EINTR) continue;
+        break;
+      }
+      std::lock_guard<std::mutex> guard(lock_);
+      connections_.emplace_back([this, fd] { serveConnection(fd); });
+    }
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      stopping_ = true;
+      queueCv_.notify_all();
+    }
+    dispatcher.join();
+    for (auto& c : connections_) c.join();
+  }
+
+  // stop accepting clients.  Connections end when their clients disconnect.
+  void stop() {
+    stopping_ = true;
+    if (listenFd_ >= 0) {
+      shutdown(listenFd_, SHUT_RDWR);
+      close(listenFd_);
+      listenFd_ = -1;
+    }
+  }
+};
+
+#endif // __unix__ || __APPLE__
+
+#endif // SORTSERVICE_HPP
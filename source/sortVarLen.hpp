@@ -0,0 +1,124 @@
+/**
+* sortVarLen.hpp
+*
+ * Copyright (c) 2023 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef SORTVARLEN_HPP
+#define SORTVARLEN_HPP
+
+// Sorting of variable length strings or blobs stored the way Arrow stores them: one buffer of bytes, data, and n + 1
+// offsets, where value i is the bytes [offsets[i], offsets[i + 1]) of data.  The values are compared as unsigned bytes
+// like memcmp, and a value comes before any longer value that it is a prefix of.
+//   parallelSortVarLenIndices(data, offsets, n, indices)             the sorted order as positions, the data unchanged
+//   parallelSortVarLen(data, offsets, n, sortedData, sortedOffsets)  a new compacted buffer and offsets in sorted order
+// Each value is sorted as a 16 byte entry holding the first 8 bytes of the value as a big endian integer and the
+// position of the value.  Most comparisons are decided by the prefixes without reading data.  Only values with
+// equal prefixes are compared in data, from the ninth byte on.  Values that are equal stay in input order.  There
+// is no allocation per value: the entries, the new offsets and the new buffer are each one array.
+
+#include <stdint.h>
+#include <cstring>
+#include <vector>
+#include "parallelSort.hpp"
+
+// varLenEntry is the prefix of a value and its position.
+struct varLenEntry {
+  uint64_t prefix;
+  size_t index;
+};
+
+// varLenPrefix returns the first 8 bytes of the len bytes at p as a big endian integer, padded with zeros.
+inline uint64_t varLenPrefix(const unsigned char* p, size_t len) {
+  uint64_t v = 0;
+  const size_t bytes = minimum(len, 8);
+  for (size_t i = 0; i < bytes; i++) v |= (uint64_t)p[i] << (56 - 8 * i);
+  return v;
+}
+
+// varLenLess orders the entries by their values and then by their positions.
+template<class Offset>
+struct varLenLess {
+  const unsigned char* data;
+  const Offset* offsets;
+
+  bool operator()(const varLenEntry& a, const varLenEntry& b) const {
+    if (a.prefix != b.prefix) return a.prefix < b.prefix;
+    const size_t aLen = (size_t)(offsets[a.index + 1] - offsets[a.index]);
+    const size_t bLen = (size_t)(offsets[b.index + 1] - offsets[b.index]);
+    const size_t common = minimum(aLen, bLen);
+    if (common > 8) {
+      int c = memcmp(data + offsets[a.index] + 8, data + offsets[b.index] + 8, common - 8);
+      if (c != 0) return c < 0;
+    }
+    if (aLen != bLen) return aLen < bLen;
+    return a.index < b.index;
+  }
+};
+
+// parallelSortVarLenEntries builds and sorts the entries of the n values.
+template< class E, class Offset, typename std::enable_if<isExecutor<E>::value, int>::type = 0>
+void parallelSortVarLenEntries(E& exec, const unsigned char* data, const Offset* offsets, size_t n, std::vector<varLenEntry>& entries, size_t threads) {
+  entries.resize(n);
+  parallelForRange(exec, (size_t)0, n, [&](size_t lb, size_t le) {
+    for (size_t i = lb; i < le; i++) {
+      entries[i].prefix = varLenPrefix(data + offsets[i], (size_t)(offsets[i + 1] - offsets[i]));
+      entries[i].index = i;
+    }
+    }, 4096, schedStatic, threads);
+  parallelSort(exec, entries.begin(), entries.end(), varLenLess<Offset>{ data, offsets }, threads);
+}
+
+// parallelSortVarLenIndices sets indices to the positions of the n values of data and offsets in sorted order.
+template< class E, class Offset, typename std::enable_if<isExecutor<E>::value, int>::type = 0>
+void parallelSortVarLenIndices(E& exec, const void* data, const Offset* offsets, size_t n, std::vector<size_t>& indices, size_t threads = 0) {
+  if (threads == 0) threads = exec.concurrency();
+  std::vector<varLenEntry> entries;
+  parallelSortVarLenEntries(exec, (const unsigned char*)data, offsets, n, entries, threads);
+  indices.resize(n);
+  parallelForRange(exec, (size_t)0, n, [&](size_t lb, size_t le) {
+    for (size_t i = lb; i < le; i++) indices[i] = entries[i].index;
+    }, 4096, schedStatic, threads);
+}
+
+// parallelSortVarLen writes the n values of data and offsets in sorted order to sortedData and sortedOffsets, which
+// are resized to the total length and to n + 1, with sortedOffsets[0] = 0.  After the sort, the new offsets are an
+// exclusive scan of the sorted lengths, and the values are copied to their new places in parallel.
+template< class E, class Offset, typename std::enable_if<isExecutor<E>::value, int>::type = 0>
+void parallelSortVarLen(E& exec, const void* data, const Offset* offsets, size_t n,
+  std::vector<unsigned char>& sortedData, std::vector<Offset>& sortedOffsets, size_t threads = 0) {
+  if (threads == 0) threads = exec.concurrency();
+  const unsigned char* bytes = (const unsigned char*)data;
+  std::vector<varLenEntry> entries;
+  parallelSortVarLenEntries(exec, bytes, offsets, n, entries, threads);
+
+  sortedOffsets.resize(n + 1);
+  parallelForRange(exec, (size_t)0, n, [&](size_t lb, size_t le) {
+    for (size_t i = lb; i < le; i++) sortedOffsets[i] = offsets[entries[i].index + 1] - offsets[entries[i].index];
+    }, 4096, schedStatic, threads);
+  sortedOffsets[n] = 0;
+  parallelExclusiveScan(exec, sortedOffsets.begin(), sortedOffsets.end(), sortedOffsets.begin(), (Offset)0, std::plus<Offset>(), 4096, threads);
+
+  sortedData.resize((size_t)sortedOffsets[n]);
+  parallelForRange(exec, (size_t)0, n, [&](size_t lb, size_t le) {
+    for (size_t i = lb; i < le; i++) {
+      const size_t len = (size_t)(sortedOffsets[i + 1] - sortedOffsets[i]);
+      if (len != 0) memcpy(sortedData.data() + sortedOffsets[i], bytes + offsets[entries[i].index], len);
+    }
+    }, 4096, schedStatic, threads);
+}
+
+template< class Offset>
+void parallelSortVarLenIndices(const void* data, const Offset* offsets, size_t n, std::vector<size_t>& indices, size_t threads = 0) {
+  parallelSortVarLenIndices(defaultExecutor(), data, offsets, n, indices, threads);
+}
+
+template< class Offset>
+void parallelSortVarLen(const void* data, const Offset* offsets, size_t n,
+  std::vector<unsigned char>& sortedData, std::vector<Offset>& sortedOffsets, size_t threads = 0) {
+  parallelSortVarLen(defaultExecutor(), data, offsets, n, sortedData, sortedOffsets, threads);
+}
+
+#endif // SORTVARLEN_HPP
@@ -0,0 +1,148 @@
+/**
+* threadPool.hpp
+*
+ * Copyright (c) 2023 John Robinson.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// taskGroup counts outstanding tasks so a caller can wait for a set of tasks with one counter
+// instead of one std::future per task.  add() is called before a task is submitted and done()
+// when it finishes.
+class taskGroup {
+  std::mutex lock_;
+  std::condition_variable cv_;
+  int64_t pending_ = 0;
+
+public:
+  void add(int64_t n = 1) {
+    std::lock_guard<std::mutex> guard(lock_);
+    pending_ += n;
+  }
+
+  void done() {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (--pending_ == 0) cv_.notify_all();
+  }
+
+  bool finished() {
+    std::lock_guard<std::mutex> guard(lock_);
+    return pending_ == 0;
+  }
+
+  void wait() {
+    std::unique_lock<std::mutex> guard(lock_);
+    cv_.wait(guard, [this] { return pending_ == 0; });
+  }
+
+  // wait at most timeout and return true if all of the tasks are done.
+  template<class Duration>
+  bool waitFor(Duration timeout) {
+    std::unique_lock<std::mutex> guard(lock_);
+    return cv_.wait_for(guard, timeout, [this] { return pending_ == 0; });
+  }
+};
+
+// threadPool is a fixed set of worker threads that run submitted tasks in FIFO order.
+class threadPool {
+  std::vector<std::thread> workers_;
+  std::deque<std::function<void()>> queue_;
+  std::mutex lock_;
+  std::condition_variable cv_;
+  bool stopping_ = false;
+
+  void workerLoop() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> guard(lock_);
+        cv_.wait(guard, [this] { return stopping_ || !queue_.empty(); });
+        if (queue_.empty()) return;
+        task = std::move(queue_.front());
+        queue_.pop_front();
+      }
+      task();
+    }
+  }
+
+public:
+  // threads = 0 means use hardware_concurrency() workers.
+  explicit threadPool(size_t threads = 0) {
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    for (size_t i = 0; i < threads; i++) workers_.emplace_back([this] { workerLoop(); });
+  }
+
+  // the destructor finishes the tasks already queued before joining the workers.
+  ~threadPool() {
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto& w : workers_) w.join();
+  }
+
+  threadPool(const threadPool&) = delete;
+  threadPool& operator=(const threadPool&) = delete;
+
+  size_t size() const { return workers_.size(); }
+
+  // run one queued task on the calling thread if there is one.  A thread that has to wait for pool tasks
+  // calls this while it waits so that tasks that wait on other tasks cannot use up all of the workers.
+  bool tryRunOne() {
+    std::function<void()> task;
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      if (queue_.empty()) return false;
+      task = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    task();
+    return true;
+  }
+
+  // wait for the tasks in group, running queued tasks in the meantime.
+  void wait(taskGroup& group) {
+    while (!group.finished()) {
+      if (!tryRunOne()) group.waitFor(std::chrono::microseconds(100));
+    }
+  }
+
+  void submit(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      queue_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+  }
+
+  // submit a task that is counted in group.
+  void submit(taskGroup& group, std::function<void()> task) {
+    group.add();
+    submit([&group, task]() {
+      task();
+      group.done();
+      });
+  }
+};
+
+// the pool shared by the parts of this library that run on pool threads.  It has hardware_concurrency() workers.
+inline threadPool& globalThreadPool() {
+  static threadPool pool;
+  return pool;
+}
+
+#endif // THREADPOOL_HPP